@@ -57,6 +57,7 @@
 //     flag[0]/Qc = ~CE _CE
 //     flag[1]/Qb = ~OE _OE
 //     flag[2]/Qa = ~WE R_W
+//     flag[3-7]/Qh-Qd = ~CE of gang sockets 5-1 (BOARD_GANG)
 //
 //
 //******************************************************************************
@@ -73,12 +74,197 @@
     * MCU will send the bytes immediately with no delimiter.  When transfer
       is complete, will return to "ready>"
 
+  Binary read from EEPROM: "read_bin <start-addr> <end-addr>"
+    * Same addressing as "read"
+    * MCU sends 'B', the byte count (16 bits, little-endian), the raw
+      bytes, and then the 16-bit little-endian sum of all the bytes.
+      When transfer is complete, will return to "ready>"
+    * A count of 0 means 65536 bytes (0x0000 to 0xffff)
+    * With rle on, MCU sends 'R' instead of 'B', and the bytes are run-
+      length encoded as for write, but with runs and literals spanning
+      the whole range.  The count and sum are of the decoded bytes
+
+  Checksum EEPROM: "crc <start-addr> <end-addr>"
+    * Same addressing as "read"
+    * MCU replies "CRC <8 hex digits>", the CRC-32 (same as zlib.crc32)
+      of the range, then returns to "ready>"
+
+  Blank check: "blank <start-addr> <end-addr> [byte]"
+    * Same addressing as "read"; byte is in hexadecimal and defaults to 0xff
+    * MCU replies "Blank" if every byte in the range holds byte, or else
+      "Mismatch at <4 hex digit addr>: <2 hex digit data>" for the first
+      one that doesn't, then returns to "ready>"
+
+  Page hashes: "pagehash <start-addr> <end-addr>"
+    * Same addressing as "read"
+    * MCU replies "Hashes <count>", then for each 64 byte page in the range
+      (the first and last may be partial, as in a paged write) the low 16
+      bits of its CRC-32 as 4 hex digits, with no delimiter, then "\r\n"
+
+  Change baud rate: "baud <rate>"
+    * Rate is in decimal, e.g. "baud 115200".  With no rate, the current
+      setting is displayed
+    * MCU replies "Baud <rate>" at the old rate, then switches.  The client
+      must send "\r" at the new rate within a second, the MCU replies "OK",
+      and the client sends a second "\r" to confirm.  If either "\r" does
+      not arrive, the MCU falls back to 9600 baud
+
+  Select EEPROM type: "chip <name>"
+    * Names are in chip_table, e.g. "chip 28c64".  With no name, the
+      current setting is displayed
+    * Default is 28c256.  MCU replies "Chip <name>: end <addr>, page <n>,
+      tWC <n>ms" and ", SDP" and ", chip erase" if the part has them.  The
+      page size is used by write, write_stream, fill, batch and pagehash,
+      tWC sets the write cycle timeout, and commands with addresses past
+      the end are rejected.  With eeprom_lock on, parts without SDP are
+      written without the sequences
+
+  Hold off data protection: "unlock [seconds]" and "lock"
+    * unlock sends the chip's SDP disable sequence once, after which
+      write, write_stream, fill, batch and binary writes skip the SDP
+      sequences eeprom_lock would send around each of them.  MCU replies
+      "Unlocked, relock after <n>s idle"
+    * lock sends the SDP enable sequence and replies "Locked".  So does
+      the MCU by itself if no input arrives at the prompt for <seconds>
+      (1 to 60, default 10), so a client that goes away doesn't leave
+      the part writable.  Changing chip or gang relocks first
+    * Either may report "Write cycle timeout" first.  Chips without SDP
+      reply "No SDP on <chip>"
+
+  Idle time: "idle [seconds]"
+    * Seconds is in decimal, 0 to 600, e.g. "idle 30".  With no time, the
+      current setting is displayed
+    * Default is 30.  After that long at the prompt with no input (and
+      once any unlock has relocked), the MCU sleeps in LPM3 instead of
+      LPM0, with SMCLK and the DCO off.  The USCI restarts SMCLK, still
+      calibrated for 16MHz, on the next start bit, so that byte and the
+      rest arrive at the usual baud divisors.  0 disables this.  Rates
+      above 115200 stay in LPM0, as the DCO's wake-up time is too large
+      a part of their bit time.  Timer_A stops too, so stats leave out
+      the time spent in LPM3
+
+  Select gang sockets: "gang <mask>"
+    * Mask is in hexadecimal, one bit per socket, e.g. "gang 0x3f".  With
+      no mask, the current setting is displayed
+    * Default is 0x01.  write and write_stream program every socket in the
+      mask at once; DATA# polling, the toggle bit and diff_write check each
+      socket in turn.  Only BOARD_GANG builds have more than one socket
+
+  Select read socket: "socket <n>"
+    * Socket is in decimal, e.g. "socket 3".  With no socket, the current
+      setting is displayed
+    * Default is 0.  read, read_bin, crc and pagehash read this socket only
+
+  Update differential write state: "diff_write <on|off>"
+    * Default is off.  When on, write and write_stream read each page back
+      before loading it, and skip the page load and write cycle if the
+      EEPROM already holds that data.  The number of skipped pages is
+      reported after the write
+
+  Update read-back state: "readback <on|off>"
+    * Default is off.  When on, write_stream reads each page back from
+      every socket in gang_mask once its write cycle is over, while the
+      next page arrives, and after the write reports "Readback CRC <socket>
+      <8 hex digits>" per socket: the CRC-32 of the range as now held
+      there, so the client can verify without reading the range again
+
+  Update run-length state: "rle <on|off>"
+    * Default is off.  When on, read_bin's reply, and the data for each
+      page (or byte, with page_write off) of write and write_stream, are
+      run-length encoded,
+      each page on its own.  A header byte c below 0x80 is followed by
+      c + 1 literal bytes; c of 0x80 or more is followed by one byte to
+      repeat c - 0x7e times (2 to 129).  Runs must not cross pages
+
+  Fill EEPROM: "fill <start-addr> <end-addr> <byte>"
+    * Addresses and byte are in hexadecimal, e.g. "fill 0x0000 0x7fff 0xff"
+    * Writes byte to every address in the range, with the same page_write,
+      eeprom_lock and diff_write handling as "write", and no data from the
+      client.  MCU sends a 'W' as each page is written, then "\r\n"
+
+  Erase EEPROM: "chip_erase [fill]"
+    * Erases the whole part (0x0000 to the chip's end address) to 0xff.
+      MCU sends the AT28C software chip erase sequence, waits out tEC, and
+      blank checks the part (every socket in gang_mask).  If that finds a
+      byte that isn't 0xff, for parts without chip erase, or with
+      "chip_erase fill", MCU sends "Filling" and fills the part as
+      "fill 0x0000 <end> 0xff" would, sending a 'W' per page and then
+      "\r\n".  Chips listed without chip erase go straight to the fill
+    * MCU finally replies "Erased", or "Mismatch at <addr>: <data>" as for
+      "blank", then returns to "ready>"
+
   Write to EEPROM: "write <start-addr> <end-addr> <[no]page>"
     * Addresses are in hexadecimal, e.g. "read 0x0000 0x7fff"
-    * MCU will go into programming mode. In paged mode, up to 64 bytes are read
-      from the serial interface, and then written in a burst, followed by a
-      10ms pause, and then another 64 bytes are read.  In non-paged mode,
-      one byte is written at a time, with a 10ms pause after each byte.
+    * MCU will go into programming mode. In paged mode, up to a page (64
+      bytes on the 28c256, see "chip") is read from the serial interface,
+      and then written in a burst, followed by the write cycle, and then
+      the next page is read.  In non-paged mode, one byte is written at a
+      time, with a write cycle after each byte.
+    * The MCU waits for each write cycle by polling DATA# (I/O7) on the
+      last byte written, or the toggle bit (I/O6) after the SDP sequences,
+      instead of a fixed delay.  If a cycle takes longer than twice the
+      chip's tWC the MCU reports "Write cycle timeout: <count>" before
+      returning to "ready>"
+
+  Streaming write to EEPROM: "write_stream <start-addr> <end-addr>"
+    * Same addressing and page_write/eeprom_lock handling as "write"
+    * MCU sends "Credit <n>", granting the client n pages (or single bytes
+      with page_write off) of receive credit.  The client sends data
+      without waiting for "S n/m" prompts, never more than n pages ahead.
+    * The MCU returns one credit, a single 'W', as soon as each page has
+      been loaded into the EEPROM, so the next page arrives during tWC.
+      After the last 'W', the MCU returns to "ready>"
+
+  Batch write to EEPROM: "batch <length>"
+    * Length is in decimal, the size in bytes of a segment list of up to
+      128 bytes.  Each segment is a 16-bit little-endian address, a length
+      byte (1 to 255), and that many data bytes
+    * MCU replies "Batch <length>", and the client sends the list raw (not
+      run-length encoded, even with rle on).  No data is written until
+      the whole list has arrived and parsed; a bad one gets "Invalid
+      batch list at byte <n>"
+    * MCU writes the segments in order, with the page_write and
+      eeprom_lock handling of "write" (diff_write doesn't apply).  Bytes
+      in the same page, in one segment or in consecutive ones, go in one
+      page load and write cycle, so the client should sort the segments
+    * MCU replies "Segments <n>, page loads <m>", then any "Write cycle
+      timeout" lines as for "write", and returns to "ready>"
+
+  Timing statistics: "stats [reset]"
+    * MCU replies with the time, in microseconds, since the last "stats
+      reset" (or power up), and how much of it was spent shifting out to
+      the 74HC595s (Shift out), waiting for the client (Host wait, which
+      includes idling at "ready>"), waiting out write cycles (Write cycle
+      wait, including its polling reads) and waiting for room to send
+      (TX wait).  Then the commands run, bytes received and sent, and
+      EEPROM bytes read and written.  Times include any interrupts taken
+      meanwhile, and wrap after about 35 minutes
+    * "stats reset" zeroes them all
+
+  Binary commands: 0xa5 <opcode> <length> <payload> <crc8>
+    * Sent in place of a text command, for a client that doesn't need the
+      prompts and banners.  length is the payload length (up to 29), and
+      crc8 is CRC-8/SMBUS (poly 0x07, init 0) of opcode, length and
+      payload.  Addresses are 16 bits, little-endian
+    * MCU replies 0x5a <status> <length lo> <length hi> <payload> <crc8>,
+      with crc8 over status, length and payload, and no "ready>" after it
+    * Status: 0 = OK, 1 = bad frame (length or crc8), 2 = bad opcode,
+      3 = bad arguments, 4 = mismatch, 5 = write cycle timeout
+    * Opcodes:
+        0x00 nop: no payload; empty reply
+        0x01 read <start> <end>: reply is the bytes, as read_bin (a
+             length of 0 means 65536)
+        0x02 write <start> <data...>: writes the data (up to 27 bytes, as
+             pages or single bytes per page_write); reply is the write
+             cycle timeout and skipped page counts, 16 bits each
+        0x03 crc <start> <end>: reply is the CRC-32, 32 bits
+        0x04 blank <start> <end> <byte>: status 0, or 4 with the first
+             mismatching address and data as the reply
+        0x05 fill <start> <end> <byte>: reply as for write
+        0x06 set <setting> <value>: sets 0 = echo, 1 = page_write,
+             2 = eeprom_lock, 3 = diff_write, 4 = rle, 5 = gang, 6 = socket
+    * A frame whose length is too long ends after 32 bytes.  To resync,
+      send 32 zero bytes and then "\r", and wait for "ready>"
 */
 
 #include <msp430.h>
@@ -86,35 +272,180 @@
 #include <stdio.h>
 #include <stdlib.h>
 
+/*** Board variants ***
+  Build with "make VARIANT=-DBOARD_SPI" for a board where USCI_B0 drives
+  the 74HC595 chains instead of bit-banged GPIO:
+
+            |     P1.5/UCB0CLK|--> SRCLK_F, SRCLK_A, SRCLK_DOUT
+            |    P1.7/UCB0SIMO|--> SER_F, SER_A, SER_DOUT
+            |             P1.3|--> RCLK_F
+            |             P1.6|--> RCLK_A
+            |             P2.4|--> RCLK_DOUT
+
+  All three chains shift every byte, but only the chain whose RCLK is
+  strobed latches it, so the others keep their outputs.  SPI runs at
+  SMCLK/2, LSB first.  P1.0, P1.4, P2.3 and P2.5 are unused.
+
+  Build with "make VARIANT=-DBOARD_SPLIT_ADDR" for a board where the two
+  address 74HC595s have separate latch clocks:
+
+            |             P1.6|--> RCLK_A  (low byte, first in chain)
+            |             P2.7|--> RCLK_AH (high byte, fed from QH')
+
+  Note the chain order is the reverse of the standard board: the high
+  byte is shifted first so it ends up in the far chip.  When only the
+  low byte changes (sequential access within a 256 byte block), just
+  8 bits are shifted and only RCLK_A is strobed; the high chip's shift
+  stage fills with junk but its outputs hold.  Uses the unrolled
+  shift-out, so it can't be combined with BOARD_SPI or SHIFTREG_GENERIC.
+
+  Add "-DBOARD_DIRECT_WE" for a board with the EEPROM's ~WE wired to a
+  spare GPIO instead of flags Qa, so a write strobe is one pin toggle
+  rather than two flags shifts.  With BOARD_SPI, "-DBOARD_DIRECT_OE" also
+  moves ~OE off flags Qb onto a freed pin:
+
+            |             P2.7|--> ~WE (BOARD_DIRECT_WE)
+            |             P1.0|--> ~OE (BOARD_DIRECT_OE, needs BOARD_SPI)
+
+  Add "-DBOARD_PARALLEL_DIN" for the 28-pin G2553 (TSSOP-28), with the
+  EEPROM data bus wired to port 3 instead of the 74HC165.  Each byte is
+  then one P3IN read instead of a load and eight clocks.  P2.0-P2.2 are
+  unused.
+
+            |        P3.0-P3.7|<-- D0-D7
+
+
+  Add "-DBOARD_GANG" for a board with up to six sockets sharing the
+  address, data and control lines, each with its own ~CE.  Socket 0 keeps
+  flags Qc; sockets 1-5 use the spare flags outputs, so the flags chain
+  shifts 8 bits instead of 3:
+
+            |    flags Qd-Qh  |--> ~CE of sockets 1-5
+
+*/
+
+#if defined(BOARD_SPLIT_ADDR) && (defined(BOARD_SPI) || defined(SHIFTREG_GENERIC))
+#error "BOARD_SPLIT_ADDR needs the unrolled shift-out"
+#endif
+#if defined(BOARD_DIRECT_WE) && defined(BOARD_SPLIT_ADDR)
+#error "BOARD_DIRECT_WE and BOARD_SPLIT_ADDR both use P2.7"
+#endif
+#if defined(BOARD_DIRECT_OE) && !defined(BOARD_SPI)
+#error "BOARD_DIRECT_OE uses P1.0, which is SER_F unless BOARD_SPI"
+#endif
+
+#ifdef BOARD_SPI
+// Port 1 - USCI_B0, shared by all shift register chains
+#define SPI_CLK  BIT5
+#define SPI_SIMO BIT7
+#define SPI_PINS SPI_CLK+SPI_SIMO
+#endif
+
 // Port 1 - flags
 #define RCLK_F   BIT3
+#ifdef BOARD_SPI
+#define SRCLK_F  SPI_CLK
+#define SER_F    SPI_SIMO
+#define F_OUT    RCLK_F
+#else
 #define SRCLK_F  BIT4
 #define SER_F    BIT0
 #define F_OUT    RCLK_F+SRCLK_F+SER_F
+#endif
 #define SENDMODE_FLAG 1
 // Flag bits
 #define _CE      BIT0
 #define _OE      BIT1
 #define R_W      BIT2
+// Gang sockets: socket 0's ~CE is _CE, the rest use
+// flags Qd-Qh, see socket_ce
+#ifdef BOARD_GANG
+#define SOCKETS  6
+#define CE_ALL   (_CE+BIT3+BIT4+BIT5+BIT6+BIT7)
+#else
+#define SOCKETS  1
+#define CE_ALL   _CE
+#endif
 // Port 1 - address
 #define RCLK_A   BIT6
+#ifdef BOARD_SPI
+#define SER_A    SPI_SIMO
+#define SRCLK_A  SPI_CLK
+#define A_OUT    RCLK_A
+#else
 #define SER_A    BIT5
 #define SRCLK_A  BIT7
 #define A_OUT    RCLK_A+SRCLK_A+SER_A
+#endif
 #define SENDMODE_ADDR 2
-
+// Flag lines wired straight to GPIO
+#ifdef BOARD_DIRECT_WE
+#define WE_DIRECT BIT7
+#define WE_OUT    WE_DIRECT
+#else
+#define WE_OUT    0
+#endif
+#ifdef BOARD_DIRECT_OE
+#define OE_DIRECT BIT0
+#define OE_OUT    OE_DIRECT
+#else
+#define OE_OUT    0
+#endif
+
+// EEPROM control strobes, via GPIO where the board
+// has it or via the flags shift register
+#ifdef BOARD_DIRECT_OE
+#define EEPROM_OE_LOW()  do { eeprom_flags &= ~_OE; P1OUT &= ~OE_DIRECT; } while(0)
+#define EEPROM_OE_HIGH() do { eeprom_flags |= _OE; P1OUT |= OE_DIRECT; } while(0)
+#else
+#define EEPROM_OE_LOW()  do { eeprom_flags &= ~_OE; send_flags(eeprom_flags); } while(0)
+#define EEPROM_OE_HIGH() do { eeprom_flags |= _OE; send_flags(eeprom_flags); } while(0)
+#endif
+#ifdef BOARD_DIRECT_WE
+#define EEPROM_WE_STROBE() do { P2OUT &= ~WE_DIRECT; P2OUT |= WE_DIRECT; } while(0)
+#else
+#define EEPROM_WE_STROBE() do {     \
+        eeprom_flags &= ~R_W;       \
+        send_flags(eeprom_flags);   \
+        eeprom_flags |= R_W;        \
+        send_flags(eeprom_flags);   \
+    } while(0)
+#endif
+
+// Port 2 - address high byte latch
+#ifdef BOARD_SPLIT_ADDR
+#define RCLK_AH  BIT7
+#define AH_OUT   RCLK_AH
+#else
+#define AH_OUT   0
+#endif
+
+#ifdef BOARD_PARALLEL_DIN
+// Port 3 - data in, the EEPROM data bus read directly
+#define DIN_CLK  0
+#define DIN_SHLD 0
+#define DIN_OUT  0
+#define DIN_IN   0
+#else
 // Port 2 - data in
 #define DIN_QH   BIT0
 #define DIN_CLK  BIT1
 #define DIN_SHLD BIT2
 #define DIN_OUT  DIN_CLK+DIN_SHLD
 #define DIN_IN   DIN_QH
+#endif
 
 // Port 2 - data out
-#define SER_DOUT   BIT3
 #define RCLK_DOUT  BIT4
-#define SRCLK_DOUT BIT5
 #define OE_DOUT    BIT6
+#ifdef BOARD_SPI
+// SER and SRCLK come from USCI_B0 on port 1
+#define SER_DOUT   0
+#define SRCLK_DOUT 0
+#else
+#define SER_DOUT   BIT3
+#define SRCLK_DOUT BIT5
+#endif
 #define DOUT_OUT   SER_DOUT+RCLK_DOUT+SRCLK_DOUT+OE_DOUT
 #define SENDMODE_DATA 3
 
@@ -125,44 +456,252 @@
 // Make 16-bit and 8-bit unsigned ints explicit
 typedef unsigned int uint16_t;
 typedef unsigned char uint8_t;
+typedef unsigned long uint32_t;
 
 // help routine
 void cmd_help();
 // serial routines
 void send_str(char *);
+void send_byte(uint8_t);
+void tx_flush();
 void echo(char);
 void pause_for_char();
+void wait_for_command();
+void set_baud(uint8_t);
+char wait_for_cr();
 // command processing routines
 void cmd_echo();
 void cmd_read();
+void cmd_read_bin();
 void cmd_write();
+void cmd_write_stream();
 void cmd_page_write();
 void cmd_eeprom_lock();
+void cmd_diff_write();
+void cmd_rle();
+void cmd_readback();
+void cmd_fill();
+void cmd_batch();
+void cmd_baud();
+void cmd_crc();
+void cmd_pagehash();
+void cmd_blank();
+void cmd_chip_erase();
+void cmd_gang();
+void cmd_socket();
+void cmd_binary();
+void cmd_stats();
+void cmd_chip();
+void cmd_unlock();
+void cmd_lock();
+void cmd_idle();
 
 // global vars
 char echo_mode = true;
 char page_write = true;
 char eeprom_lock = true;
+char diff_write = false;
+char rle = false;
+char readback = false;
+// Set by unlock: write_begin() and write_end() skip the
+// SDP sequences until lock, or until the prompt has been
+// idle for relock_overflows Timer_A overflows (32.768ms
+// each), see wait_for_command()
+char sdp_unlocked = false;
+#define RELOCK_DEFAULT 10
+#define RELOCK_MAX 60
+uint16_t relock_overflows;
+volatile uint16_t idle_overflows;
+volatile char relock_due;
+volatile char at_prompt;
+// Set by the RX ISR when a text command or binary frame
+// is complete
+volatile char cmd_done;
+// Idle time at the prompt, in Timer_A overflows, before
+// TIMER0_A1_ISR drops to LPM3; 0 = never.  deep_idle is
+// set while it is there, until the RX ISR takes the
+// next byte.
+#define IDLE_DEFAULT 30
+#define IDLE_MAX 600
+#define DEEP_IDLE_MAX_RATE 115200
+uint16_t idle_limit = IDLE_DEFAULT * 31;
+volatile char deep_idle;
 char cmd[32];
-char write_buf[64];
+// Page buffers.  write uses write_buf[0]; write_stream
+// cycles through all of them and grants one page of
+// credit per buffer.  PAGE_MAX is the largest page a
+// chip_table entry can have.
+#define WRITE_BUFS 2
+#define PAGE_MAX 64
+char write_buf[WRITE_BUFS][PAGE_MAX];
 char eeprom_flags = 0;
 int write_buf_idx = 0;
 int write_buf_target_size = 0;
 #define SERMODE_WRITE 0
 #define SERMODE_CMD   1
 #define SERMODE_ECHO  2
+#define SERMODE_STREAM 3
+#define SERMODE_BINARY 4
 char serial_mode = SERMODE_CMD;
+// write_stream state: the RX ISR fills write_buf[stream_fill]
+// while cmd_write_stream() programs the others
+uint8_t stream_fill;
+volatile uint8_t stream_full[WRITE_BUFS];
+uint8_t stream_len[WRITE_BUFS];
+uint16_t stream_rx_addr;
+uint16_t stream_rx_remaining;
+char stream_overrun;
+// rle decoder state, see rx_store(): literal bytes still
+// to copy, and the count for a repeat still to come.
+// Reset at the start of each page.
+uint8_t rle_literal;
+uint8_t rle_repeat;
+// Longest literal read_bin sends with rle on.  They are
+// staged in write_buf, which is free during reads.
+#define RLE_LITERAL_MAX 128
+#if WRITE_BUFS * PAGE_MAX < RLE_LITERAL_MAX
+#error "write_buf is too small to stage rle literals"
+#endif
+// Longest segment list batch takes.  It is collected
+// across all of write_buf.
+#define BATCH_MAX (WRITE_BUFS * PAGE_MAX)
+// Write cycles that didn't finish within POLL_TIMEOUT
+// Timer_A ticks (twice the chip's tWC) of the start of
+// the wait, see poll_data(); reset by write_begin()
+#define POLL_TIMEOUT (chip->twc * 2000UL * TICKS_PER_US)
+uint16_t write_timeouts;
+// Pages that diff_write found already programmed; reset
+// by write_begin()
+uint16_t pages_skipped;
+// Sockets written by write and write_stream, one bit
+// each, and the socket read by read, crc, etc.
+uint8_t gang_mask = 0x01;
+uint8_t read_socket = 0;
+// Sockets with a write cycle timeout; reset by write_begin()
+uint8_t sockets_timed_out;
+// Running CRC-32 per socket of what write_stream has
+// written, read back with readback on
+uint32_t readback_crc[SOCKETS];
 uint16_t cur_write_addr;
 uint16_t end_write_addr;
 
+// TX ring buffer, filled by send_byte() and drained
+// by USCI0TX_ISR.  Size must be a power of two.
+#define TX_BUF_SIZE 32
+#define TX_BUF_MASK (TX_BUF_SIZE - 1)
+char tx_buf[TX_BUF_SIZE];
+volatile uint8_t tx_head = 0;
+volatile uint8_t tx_tail = 0;
+const char hex_digits[] = "0123456789abcdef";
+
+// Binary command frames, collected in cmd by the RX ISR.
+// bin_idx counts the bytes after BIN_START.
+#define BIN_START       0xa5
+#define BIN_REPLY       0x5a
+#define BIN_PAYLOAD_MAX (sizeof(cmd) - 3)
+uint8_t bin_idx;
+// crc8 of the reply being sent, see bin_reply_begin()
+uint8_t bin_crc;
+#define OP_NOP   0x00
+#define OP_READ  0x01
+#define OP_WRITE 0x02
+#define OP_CRC   0x03
+#define OP_BLANK 0x04
+#define OP_FILL  0x05
+#define OP_SET   0x06
+#define ST_OK        0
+#define ST_BAD_FRAME 1
+#define ST_BAD_OP    2
+#define ST_BAD_ARGS  3
+#define ST_MISMATCH  4
+#define ST_TIMEOUT   5
+
+// Timer_A free-runs at SMCLK/8 (2MHz, 0.5us per tick) for
+// the stats command; TIMER0_A1_ISR counts its overflows.
+// stat_ticks are ticks spent in each kind of wait, and
+// stat_count what was moved, since stat_reset_time.
+// Only the main loop adds to stat_ticks, so its 32-bit
+// updates needn't keep the ISRs out.
+#define TICKS_PER_US  2
+#define STAT_SHIFT    0
+#define STAT_HOST     1
+#define STAT_TWC      2
+#define STAT_TX       3
+#define STAT_TIMES    4
+#define STAT_COMMANDS 0
+#define STAT_RX_BYTES 1
+#define STAT_TX_BYTES 2
+#define STAT_READS    3
+#define STAT_WRITES   4
+#define STAT_COUNTS   5
+volatile uint16_t timer_overflows;
+uint32_t stat_reset_time;
+uint32_t stat_ticks[STAT_TIMES];
+volatile uint32_t stat_count[STAT_COUNTS];
+const char * const stat_time_names[STAT_TIMES] = {
+    "Shift out", "Host wait", "Write cycle wait", "TX wait",
+};
+const char * const stat_count_names[STAT_COUNTS] = {
+    "Commands", "RX bytes", "TX bytes", "EEPROM reads", "EEPROM writes",
+};
+// Times a section shorter than one TAR wrap (32ms); longer
+// ones use timer_now()
+#define STAT_BEGIN()  uint16_t stat_begin = TAR
+#define STAT_END(n)   (stat_ticks[n] += (uint16_t)(TAR - stat_begin))
+
+// CRC-8/SMBUS (poly 0x07) one nibble at a time
+const uint8_t crc8_nibble[16] = {
+    0x00, 0x07, 0x0e, 0x09, 0x1c, 0x1b, 0x12, 0x15,
+    0x38, 0x3f, 0x36, 0x31, 0x24, 0x23, 0x2a, 0x2d,
+};
+
+// CRC-32 (IEEE 802.3, reflected, poly 0xedb88320) one
+// nibble at a time, so the table is 64 bytes of flash
+// rather than 1KB
+const uint32_t crc32_nibble[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac,
+    0x76dc4190, 0x6b6b51f4, 0x4db26158, 0x5005713c,
+    0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+    0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c,
+};
+
+// USCI_A0 divisors for 16MHz SMCLK, low-frequency mode (UCOS16 = 0).
+// UCBRSx is from the MSP430 user guide, table 15-4, where listed,
+// otherwise round(8 * frac(16MHz / rate)).
+struct baud_setting {
+    uint32_t rate;
+    uint16_t br;
+    uint8_t mctl;
+};
+const struct baud_setting baud_table[] = {
+    {   9600, 1666, UCBRS_6 },
+    {  19200,  833, UCBRS_2 },
+    {  38400,  416, UCBRS_6 },
+    {  57600,  277, UCBRS_6 },
+    { 115200,  138, UCBRS_7 },
+    { 230400,   69, UCBRS_4 },
+    { 460800,   34, UCBRS_6 },
+    {      0,    0, 0 },
+};
+#define BAUD_DEFAULT 0
+uint8_t baud_idx = BAUD_DEFAULT;
+
+// ~CE flag bit of each socket.  The flags byte is
+// shifted out bits 3-7 then 0-2, so bit 3 lands on Qh.
+#ifdef BOARD_GANG
+const uint8_t socket_ce[SOCKETS] = { _CE, BIT7, BIT6, BIT5, BIT4, BIT3 };
+#else
+const uint8_t socket_ce[SOCKETS] = { _CE };
+#endif
+
 // software data protection sequences
-uint16_t enable_data_protect[4][2] = {
+const uint16_t enable_data_protect[4][2] = {
     { 0x5555, 0x00aa },
     { 0x2aaa, 0x0055 },
     { 0x5555, 0x00a0 },
     { 0x0000, 0x0000 },
 };
-uint16_t disable_data_protect[7][2] = {
+const uint16_t disable_data_protect[7][2] = {
     { 0x5555, 0x00aa },
     { 0x2aaa, 0x0055 },
     { 0x5555, 0x0080 },
@@ -171,12 +710,115 @@ uint16_t disable_data_protect[7][2] = {
     { 0x5555, 0x0020 },
     { 0x0000, 0x0000 },
 };
+// The same for 8KB parts, which decode 13 address bits
+const uint16_t enable_data_protect_64[4][2] = {
+    { 0x1555, 0x00aa },
+    { 0x0aaa, 0x0055 },
+    { 0x1555, 0x00a0 },
+    { 0x0000, 0x0000 },
+};
+const uint16_t disable_data_protect_64[7][2] = {
+    { 0x1555, 0x00aa },
+    { 0x0aaa, 0x0055 },
+    { 0x1555, 0x0080 },
+    { 0x1555, 0x00aa },
+    { 0x0aaa, 0x0055 },
+    { 0x1555, 0x0020 },
+    { 0x0000, 0x0000 },
+};
+// software chip erase sequence, for parts that have it
+const uint16_t chip_erase_sequence[7][2] = {
+    { 0x5555, 0x00aa },
+    { 0x2aaa, 0x0055 },
+    { 0x5555, 0x0080 },
+    { 0x5555, 0x00aa },
+    { 0x2aaa, 0x0055 },
+    { 0x5555, 0x0010 },
+    { 0x0000, 0x0000 },
+};
+
+// EEPROM types for the chip command.  end is the last
+// address, page the bytes loaded per write cycle (1 for
+// byte-write parts, at most PAGE_MAX), and twc the
+// longest write cycle in ms; polling gives up after
+// 2 * twc ms, see POLL_TIMEOUT.  The SDP and chip erase
+// sequences are 0 for parts without them.
+struct chip_profile {
+    char *name;
+    uint16_t end;
+    uint8_t page;
+    uint8_t twc;
+    const uint16_t (*lock)[2];
+    const uint16_t (*unlock)[2];
+    const uint16_t (*erase)[2];
+};
+const struct chip_profile chip_table[] = {
+    { "28c256",    0x7fff, 64, 10, enable_data_protect, disable_data_protect, chip_erase_sequence },
+    // 128 byte pages, but write_buf holds 64
+    { "x28hc256",  0x7fff, 64,  5, enable_data_protect, disable_data_protect, 0 },
+    { "28c64",     0x1fff, 64, 10, enable_data_protect_64, disable_data_protect_64, 0 },
+    { "cat28c64b", 0x1fff, 32,  5, enable_data_protect_64, disable_data_protect_64, 0 },
+    { "28c16",     0x07ff,  1,  1, 0, 0, 0 },
+    { 0,           0,       0,  0, 0, 0, 0 },
+};
+#define CHIP_DEFAULT 0
+const struct chip_profile *chip = &chip_table[CHIP_DEFAULT];
 
 // shift register routines
 void shiftreg_send(uint8_t *, uint8_t);
 void send_flags(uint8_t);
 void send_data(uint8_t);
 void send_addr(uint16_t);
+uint8_t ce_flags(uint8_t);
+void select_sockets(uint8_t);
+#ifdef BOARD_SPI
+void spi_send(uint8_t);
+#endif
+// EEPROM read routines
+void read_begin();
+uint8_t read_byte(uint16_t);
+uint8_t sample_data();
+void read_end();
+char parse_range(char *, uint16_t *, uint16_t *);
+char check_blank(uint16_t, uint16_t, uint8_t, uint16_t *, uint8_t *);
+char gang_blank(uint16_t *, uint8_t *);
+char parse_byte_arg(char *, uint8_t *);
+// EEPROM write routines
+void write_banner();
+uint16_t page_len(uint16_t, uint16_t);
+char sdp_send(const uint16_t (*)[2]);
+char sdp_relock();
+void write_begin();
+void write_byte(uint16_t, uint8_t);
+void write_page(uint16_t, char *, uint16_t);
+void write_end();
+uint8_t poll_byte(uint16_t);
+char wait_data_polling(uint16_t, uint8_t);
+char wait_toggle_bit(uint16_t);
+char poll_data(uint16_t, uint8_t, uint32_t);
+char poll_toggle(uint16_t, uint32_t);
+char page_matches(uint16_t, char *, uint16_t);
+void readback_page(uint16_t, uint16_t);
+void rx_store(char *, uint8_t);
+void fill_range(uint8_t, char);
+uint16_t batch_write(uint8_t *, uint16_t);
+void write_report();
+// run-length encoding routines
+uint8_t rle_flush_run(char *, uint8_t, uint8_t, uint8_t);
+void rle_send_literal(char *, uint8_t);
+// checksum routines
+uint32_t crc32_update(uint32_t, uint8_t);
+uint32_t crc_range(uint16_t, uint16_t);
+uint8_t crc8_update(uint8_t, uint8_t);
+// timing routines
+uint32_t timer_now();
+void stats_reset();
+// binary reply routines
+void bin_reply_begin(uint8_t, uint16_t);
+void bin_reply_byte(uint8_t);
+void bin_reply_end();
+void bin_reply(uint8_t, uint8_t *, uint8_t);
+void bin_write_status();
 
 int main(void)
 {
@@ -188,20 +830,43 @@ int main(void)
 
     P1SEL = BIT1 + BIT2 ;                     // P1.1 = RXD, P1.2=TXD
     P1SEL2 = BIT1 + BIT2 ;                    // P1.1 = RXD, P1.2=TXD
-    P1DIR = (F_OUT+A_OUT);                    // Port 1 outputs
+    P1OUT |= OE_OUT;                          // ~OE idles high, before it's an output
+    P1DIR = (F_OUT+A_OUT+OE_OUT);             // Port 1 outputs
 
     P2SEL = 0;                                // Port 2 == GPIO
     P2SEL2 = 0;                               // Port 2 == GPIO
-    P2DIR = (DIN_OUT+DOUT_OUT);               // Port 2 outputs
+    P2OUT |= WE_OUT;                          // ~WE idles high, before it's an output
+    P2DIR = (DIN_OUT+DOUT_OUT+AH_OUT+WE_OUT); // Port 2 outputs
     P2DIR &= ~(DIN_IN);                       // Port 2 inputs
+#ifdef BOARD_PARALLEL_DIN
+    P3SEL = 0;                                // Port 3 == GPIO
+    P3SEL2 = 0;
+    P3REN = 0;
+    P3DIR = 0;                                // Port 3 inputs (data bus)
+#endif
 
     // Start in safe state
     P1OUT &= ~(SER_F + RCLK_F + SRCLK_F);
     P1OUT &= ~(SER_A + RCLK_A + SRCLK_A);
     P2OUT &= ~(DIN_CLK + DIN_SHLD);
     P2OUT &= ~(SER_DOUT + RCLK_DOUT + SRCLK_DOUT);
+    P2OUT &= ~(AH_OUT);
     P2OUT |= OE_DOUT;
 
+#ifdef BOARD_SPI
+    // USCI_B0: 3-pin SPI master, SMCLK/2, LSB first.  The
+    // 74HC595 samples SER on the rising edge of SRCLK, so
+    // capture on the first (rising) edge: UCCKPH=1, UCCKPL=0
+    UCB0CTL1 = UCSWRST;
+    UCB0CTL0 = UCCKPH + UCMST + UCMODE_0 + UCSYNC;
+    UCB0CTL1 |= UCSSEL_2;                     // SMCLK
+    UCB0BR0 = 2;                              // SMCLK/2 => 8MHz
+    UCB0BR1 = 0;
+    P1SEL |= SPI_PINS;                        // P1.5 = UCB0CLK, P1.7 = UCB0SIMO
+    P1SEL2 |= SPI_PINS;
+    UCB0CTL1 &= ~UCSWRST;                     // **Initialize USCI state machine**
+#endif
+
     /*
        For table of values see MSP430 user guide,
        table 15-4 on page 424
@@ -213,11 +878,17 @@ int main(void)
     //UCA0BR0 = 65;                             // 8MHz 9600 = 833 [low=65]
     //UCA0BR1 = 3;                              // 8MHz 9600 = 833 [hi=3<<8 := 768]
     //UCA0MCTL = UCBRS1;                        // 8MHz Modulation UCBRSx = 2
-    UCA0BR0 = 130;                            // 16MHz 9600 = 1666 [low=130]
-    UCA0BR1 = 6;                              // 16MHz 9600 = 1666 [hi=6<<8 := 1536]
-    UCA0MCTL = UCBRS2 + UCBRS1;               // 16MHz Modulation UCBRSx = 6
+    //UCA0BR0 = 130;                           // 16MHz 9600 = 1666 [low=130]
+    //UCA0BR1 = 6;                             // 16MHz 9600 = 1666 [hi=6<<8 := 1536]
+    //UCA0MCTL = UCBRS2 + UCBRS1;              // 16MHz Modulation UCBRSx = 6
+    set_baud(BAUD_DEFAULT);                   // 16MHz 9600, see baud_table
 
-    UCA0CTL1 &= ~UCSWRST;                     // **Initialize USCI state machine**
+    // Timer_A for the stats command: SMCLK/8, continuous
+    // mode, overflow interrupt
+    TACTL = TASSEL_2 + ID_3 + MC_2 + TAIE;
+
+    // Enable interrupts so USCI0TX_ISR can drain tx_buf
+    __enable_interrupt();
 
     // Set ~OE on the data-out shift register,
     // as the ~OE line on the EEPROM is in an
@@ -226,33 +897,82 @@ int main(void)
 
     serial_mode = SERMODE_CMD;
     send_str("\r\n");
+    char prompt = true;
     while(1) {
         // Send ready prompt
-        send_str("ready>");
+        if(prompt)
+            send_str("ready>");
+        prompt = true;
 
-        pause_for_char();
+        wait_for_command();
+        if(serial_mode == SERMODE_BINARY || cmd[0])
+            stat_count[STAT_COMMANDS]++;
 
         // Analyze the command and call the
         // appropriate routine
-        if(strlen(cmd) == 0)
+        if(serial_mode == SERMODE_BINARY) {
+            cmd_binary();
+            serial_mode = SERMODE_CMD;
+            // the reply frame is all the client needs
+            prompt = false;
+        }
+        else if(strlen(cmd) == 0)
             // do nothing; just loop back 
             // to a command prompt
             noop;
         else if(strncmp(cmd, "echo", 4) == 0)
             cmd_echo();
+        else if(strncmp(cmd, "readback", 8) == 0)
+            cmd_readback();
+        else if(strncmp(cmd, "read_bin", 8) == 0)
+            cmd_read_bin();
         else if(strncmp(cmd, "read", 4) == 0)
             cmd_read();
+        else if(strncmp(cmd, "pagehash", 8) == 0)
+            cmd_pagehash();
+        else if(strncmp(cmd, "blank", 5) == 0)
+            cmd_blank();
+        else if(strncmp(cmd, "chip_erase", 10) == 0)
+            cmd_chip_erase();
+        else if(strncmp(cmd, "chip", 4) == 0)
+            cmd_chip();
+        else if(strncmp(cmd, "crc", 3) == 0)
+            cmd_crc();
+        else if(strncmp(cmd, "write_stream", 12) == 0)
+            cmd_write_stream();
         else if(strncmp(cmd, "write", 5) == 0)
             cmd_write();
         else if(strncmp(cmd, "page_write", 10) == 0)
             cmd_page_write();
         else if(strncmp(cmd, "eeprom_lock", 11) == 0)
             cmd_eeprom_lock();
+        else if(strncmp(cmd, "diff_write", 10) == 0)
+            cmd_diff_write();
+        else if(strncmp(cmd, "rle", 3) == 0)
+            cmd_rle();
+        else if(strncmp(cmd, "fill", 4) == 0)
+            cmd_fill();
+        else if(strncmp(cmd, "batch", 5) == 0)
+            cmd_batch();
+        else if(strncmp(cmd, "baud", 4) == 0)
+            cmd_baud();
+        else if(strncmp(cmd, "gang", 4) == 0)
+            cmd_gang();
+        else if(strncmp(cmd, "socket", 6) == 0)
+            cmd_socket();
+        else if(strncmp(cmd, "stats", 5) == 0)
+            cmd_stats();
+        else if(strncmp(cmd, "unlock", 6) == 0)
+            cmd_unlock();
+        else if(strncmp(cmd, "lock", 4) == 0)
+            cmd_lock();
+        else if(strncmp(cmd, "idle", 4) == 0)
+            cmd_idle();
         else if(strncmp(cmd, "help", 4) == 0)
             cmd_help();
         else
             send_str("Invalid command\r\n");
-        strcpy(cmd, "");
+        memset(cmd, 0, sizeof(cmd));
     }
 }
 
@@ -262,11 +982,32 @@ void cmd_help() {
     send_str("echo {on,off}: display, enable, disable echo\r\n");
     send_str("page_write {on,off}: display, enable, disable page write mode\r\n");
     send_str("eeprom_lock {on,off}: display, enable, disable EEPROM lock mode\r\n");
+    send_str("diff_write {on,off}: display, enable, disable skipping unchanged pages\r\n");
+    send_str("readback {on,off}: display, enable, disable write_stream read-back CRCs\r\n");
+    send_str("rle {on,off}: display, enable, disable run-length encoded data\r\n");
+    send_str("baud [rate]: display or change the serial baud rate\r\n");
+    send_str("gang [0x3f]: display or change the sockets written at once\r\n");
+    send_str("socket [n]: display or change the socket read\r\n");
+    send_str("chip [name]: display or change the EEPROM type\r\n");
     send_str("read 0xabcd 0xef01: read bytes from start to end addr, inclusive\r\n");
+    send_str("read_bin 0xabcd 0xef01: same as read, but framed raw binary\r\n");
+    send_str("crc 0xabcd 0xef01: CRC-32 of bytes from start to end addr, inclusive\r\n");
+    send_str("pagehash 0xabcd 0xef01: 16-bit hash of each page in range\r\n");
+    send_str("blank 0xabcd 0xef01 [0xff]: check every byte in range holds a value\r\n");
     send_str("write 0xabcd 0xef01: write bytes from start to end addr.\r\n");
-    send_str("- If page_write enabled, 64 byte pages will be written with\r\n");
-    send_str("  10ms pauses between each page.  Otherwise, each byte will\r\r");
-    send_str("  be written individually with 10ms pauses in between.\r\n");
+    send_str("- If page_write enabled, pages will be written with a write\r\n");
+    send_str("  cycle after each page.  Otherwise, each byte will be\r\n");
+    send_str("  written individually with a write cycle after each.\r\n");
+    send_str("write_stream 0xabcd 0xef01: same as write, but without prompts.\r\n");
+    send_str("- Credit <n> grants n pages; a 'W' returns one as each is written\r\n");
+    send_str("fill 0xabcd 0xef01 0xff: write one byte value from start to end addr\r\n");
+    send_str("batch <length>: write a list of address, length, data segments\r\n");
+    send_str("chip_erase [fill]: erase the whole part, by fill if chip erase fails\r\n");
+    send_str("stats [reset]: display or zero timing and byte counters\r\n");
+    send_str("unlock [seconds]: hold SDP off until lock or seconds idle\r\n");
+    send_str("lock: re-enable SDP after unlock\r\n");
+    send_str("idle [seconds]: display or change the time before LPM3 at the prompt\r\n");
+    send_str("0xa5 <op> <len> <payload> <crc8>: binary command, see main.c\r\n");
     send_str("- If eeprom_lock enabled, the Atmel software write protection\r\n");
     send_str("  routine will be executed before and after writing\r\n");
 }
@@ -275,6 +1016,8 @@ void cmd_help() {
 // arrive on the serial interface.  USCI0RX_ISR
 // is executed when the byte arrives.
 void pause_for_char() {
+    uint32_t start = timer_now();
+
     // Enable USCI_A0 RX interrupt
     IE2 |= UCA0RXIE;
 
@@ -285,6 +1028,68 @@ void pause_for_char() {
     // Disable the serial interrupts while we
     // process the command
     IE2 &= ~UCA0RXIE;
+    stat_ticks[STAT_HOST] += timer_now() - start;
+}
+
+// Waits at the prompt for the RX ISR to collect a
+// command.  If unlock's idle timeout passes first,
+// TIMER0_A1_ISR wakes us to relock the EEPROM; RX stays
+// enabled meanwhile, so nothing typed is lost.  After
+// idle_limit, TIMER0_A1_ISR puts us back to sleep in
+// LPM3 rather than LPM0.
+void wait_for_command() {
+    uint32_t start = timer_now();
+
+    cmd_done = false;
+    relock_due = false;
+    idle_overflows = 0;
+    at_prompt = true;
+    IE2 |= UCA0RXIE;
+
+    __disable_interrupt();
+    while(!cmd_done) {
+        if(relock_due) {
+            relock_due = false;
+            __enable_interrupt();
+            stat_ticks[STAT_HOST] += timer_now() - start;
+            sdp_relock();
+            start = timer_now();
+            __disable_interrupt();
+            continue;
+        }
+        __bis_SR_register(LPM0_bits + GIE);
+        __disable_interrupt();
+    }
+    __enable_interrupt();
+
+    at_prompt = false;
+    IE2 &= ~UCA0RXIE;
+    stat_ticks[STAT_HOST] += timer_now() - start;
+}
+
+// Reprograms the USCI_A0 divisors from baud_table
+void set_baud(uint8_t idx) {
+    // Let anything queued finish at the old rate
+    tx_flush();
+
+    UCA0CTL1 |= UCSWRST;
+    UCA0BR0 = baud_table[idx].br & 0xff;
+    UCA0BR1 = baud_table[idx].br >> 8;
+    UCA0MCTL = baud_table[idx].mctl;
+    UCA0CTL1 &= ~UCSWRST;                     // **Initialize USCI state machine**
+    baud_idx = idx;
+}
+
+// Polls the serial interface for about one second,
+// waiting for a carriage return.  Other characters
+// are discarded.  The RX interrupt must be disabled.
+char wait_for_cr() {
+    for(uint16_t i=0; i<10000; i++) {
+        if((IFG2 & UCA0RXIFG) && UCA0RXBUF == 0x0d)
+            return true;
+        __delay_cycles(1600); // 1600 cycles @ 16MHz => 100us
+    }
+    return false;
 }
 
 // Echo command: change echo_mode
@@ -341,292 +1146,1738 @@ void cmd_eeprom_lock() {
     }
 }
 
-// Read command: read from EEPROM
-void cmd_read() {
-    uint16_t start_addr;
-    uint16_t end_addr;
-    uint8_t read_byte;
-    uint8_t mask;
+// diff_write command: change diff_write mode
+void cmd_diff_write() {
     char buf[64];
-
-    if(strlen(cmd) != 18) {
-        sprintf(buf, "Invalid read command: wrong length: %d, expecting 18\r\n", strlen(cmd));
+    if(strcmp(cmd, "diff_write on") == 0) {
+        diff_write = true;
+    }
+    else if(strcmp(cmd, "diff_write off") == 0) {
+        diff_write = false;
+    }
+    else {
+        if(diff_write)
+            sprintf(buf, "Current diff_write setting: %d (enabled)\r\n", diff_write);
+        else
+            sprintf(buf, "Current diff_write setting: %d (disabled)\r\n", diff_write);
         send_str(buf);
-        return;
     }
-    // read 0xabcd 0xef01
-    // 0      ^7     ^14
-    start_addr = strtoul(&cmd[7], 0, 16);
-    end_addr = strtoul(&cmd[14], 0, 16);
-    if(start_addr == 0 && strncmp(&cmd[7], "0000", 4) != 0) {
-        send_str("Invalid read command: cannot parse start addr\r\n");
-        return;
+}
+
+// rle command: change rle mode
+void cmd_rle() {
+    char buf[64];
+    if(strcmp(cmd, "rle on") == 0) {
+        rle = true;
     }
-    if(end_addr == 0 && strncmp(&cmd[14], "0000", 4) != 0) {
-        send_str("Invalid read command: cannot parse end addr\r\n");
-        return;
+    else if(strcmp(cmd, "rle off") == 0) {
+        rle = false;
     }
-    if(start_addr > end_addr) {
-        send_str("Invalid read command: start-addr > end-addr\r\n");
-        return;
+    else {
+        if(rle)
+            sprintf(buf, "Current rle setting: %d (enabled)\r\n", rle);
+        else
+            sprintf(buf, "Current rle setting: %d (disabled)\r\n", rle);
+        send_str(buf);
     }
-    sprintf(buf, "Start addr: %04x (%u)\r\n", start_addr, start_addr);
-    send_str(buf);
-    sprintf(buf, "End addr: %04x (%u)\r\n", end_addr, end_addr);
-    send_str(buf);
-    sprintf(buf, "Requesting %u bytes now...\r\n", end_addr - start_addr + 1);
-    send_str(buf);
+}
 
-    // Disable the data write shift register's outputs
-    // by pulling its _OE pin high
-    P2OUT |= OE_DOUT;
-    // Set the EEPROM flags to a known state
-    // R_W high (strobe low to write)
-    // _OE low  (data pins are outputs)
-    // _CE low  (chip enabled)
-    eeprom_flags = R_W;
-    send_flags(eeprom_flags);
+// readback command: change readback mode
+void cmd_readback() {
+    char buf[64];
+    if(strcmp(cmd, "readback on") == 0) {
+        readback = true;
+    }
+    else if(strcmp(cmd, "readback off") == 0) {
+        readback = false;
+    }
+    else {
+        if(readback)
+            sprintf(buf, "Current readback setting: %d (enabled)\r\n", readback);
+        else
+            sprintf(buf, "Current readback setting: %d (disabled)\r\n", readback);
+        send_str(buf);
+    }
+}
 
-    // Set the shift register's pins to known states
-    P2OUT &= ~DIN_CLK;
-    P2OUT |= DIN_SHLD;
+// baud command: change the serial baud rate
+void cmd_baud() {
+    char buf[64];
+    uint32_t rate;
+    uint8_t idx;
 
-    // Iterate through each address
-    for(uint16_t i=start_addr; i<=end_addr; i++) {
-        // Set the address
-        send_addr(i);
-        // Strobe the SH/~LD pin and strobe the clock to load the byte
-        P2OUT &= ~DIN_SHLD;
-        P2OUT |= DIN_CLK;
-        P2OUT &= ~DIN_CLK;
-        P2OUT |= DIN_SHLD;
+    if(strlen(cmd) <= 5) {
+        sprintf(buf, "Current baud setting: %lu\r\n", baud_table[baud_idx].rate);
+        send_str(buf);
+        return;
+    }
 
-        // the LSB of the EEPROM data is now on QH
-        read_byte = 0x00;
-        mask = 0x01;
-        while(1) {
-            if(P2IN & DIN_QH)
-                read_byte |= mask;
-            if(mask >= 0x80)
-                break;
-            mask = (mask << 1);
-            // Shift bits on rising clock edge
-            P2OUT |= DIN_CLK;
-            P2OUT &= ~DIN_CLK;
-        }
+    rate = strtoul(&cmd[5], 0, 10);
+    for(idx=0; baud_table[idx].rate > 0; idx++) {
+        if(baud_table[idx].rate == rate)
+            break;
+    }
+    if(baud_table[idx].rate == 0) {
+        sprintf(buf, "Invalid baud rate: %lu\r\n", rate);
+        send_str(buf);
+        return;
+    }
 
-        if(echo_mode) {
-            sprintf(buf, "%02x", read_byte);
-            send_str(buf);
-        }
+    sprintf(buf, "Baud %lu\r\n", rate);
+    send_str(buf);
+    set_baud(idx);
+
+    // Round-trip test at the new rate: the client sends
+    // "\r", we answer "OK", and the client confirms with
+    // a second "\r"
+    if(wait_for_cr()) {
+        send_str("OK\r\n");
+        if(wait_for_cr())
+            return;
     }
 
-    // Set the EEPROM flags to a known state
-    // R_W high (strobe low to write)
-    // _OE high (data pins are inputs)
-    // _CE low  (chip enabled)
-    eeprom_flags = R_W + _OE;
-    send_flags(eeprom_flags);
+    // No confirmation, so the client is not listening at
+    // this rate.  Fall back to the default.
+    set_baud(BAUD_DEFAULT);
 }
 
-// Write command: write to EEPROM
-void cmd_write() {
-    char buf[128];
-    int len;
+// gang command: change the sockets written by write
+// and write_stream
+void cmd_gang() {
+    char buf[48];
+    uint16_t mask;
 
-    len = strlen(cmd);
-    if(len != 19) {
-        sprintf(buf, "Invalid write command: wrong length: %d, expecting 19\r\n", len);
+    if(strlen(cmd) <= 5) {
+        sprintf(buf, "Current gang setting: 0x%02x\r\n", gang_mask);
         send_str(buf);
         return;
     }
-    // write 0xabcd 0xef01
-    // 0       ^8     ^15 
-    cur_write_addr = strtoul(&cmd[8], 0, 16);
-    end_write_addr = strtoul(&cmd[15], 0, 16);
-    if(cur_write_addr == 0 && strncmp(&cmd[8], "0000", 4) != 0) {
-        send_str("Invalid write command: cannot parse start addr\r\n");
+
+    mask = strtoul(&cmd[5], 0, 16);
+    if(mask == 0 || mask >= (1 << SOCKETS)) {
+        sprintf(buf, "Invalid gang mask: 0x%02x\r\n", mask);
+        send_str(buf);
         return;
     }
-    if(end_write_addr == 0 && strncmp(&cmd[15], "0000", 4) != 0) {
-        send_str("Invalid write command: cannot parse end addr\r\n");
+    sdp_relock();
+    gang_mask = mask;
+}
+
+// socket command: change the socket read by read,
+// read_bin, crc and pagehash
+void cmd_socket() {
+    char buf[48];
+    uint16_t socket;
+
+    if(strlen(cmd) <= 7) {
+        sprintf(buf, "Current socket setting: %u\r\n", read_socket);
+        send_str(buf);
         return;
     }
-    if(cur_write_addr > end_write_addr) {
-        send_str("Invalid write command: start-addr > end-addr\r\n");
+
+    socket = strtoul(&cmd[7], 0, 10);
+    if(socket >= SOCKETS) {
+        sprintf(buf, "Invalid socket: %u\r\n", socket);
+        send_str(buf);
         return;
     }
+    read_socket = socket;
+}
 
-    sprintf(buf, "Start addr: %04x (%u)\r\n", cur_write_addr, cur_write_addr);
-    send_str(buf);
-    sprintf(buf, "End addr: %04x (%u)\r\n", end_write_addr, end_write_addr);
-    send_str(buf);
-    sprintf(buf, "Total bytes to write: %u\r\n", end_write_addr - cur_write_addr + 1);
-    send_str(buf);
-    if(page_write)
-        send_str("Paging\r\n");
-    else
-        send_str("No Paging\r\n");
-    if(eeprom_lock)
-        send_str("EEPROM Lock Enabled\r\n");
-    else
-        send_str("EEPROM Lock Disabled\n");
-
-    // Set the EEPROM flags to a known state
-    // R_W high (strobe low to write)
-    // _OE high (data pins are inputs)
-    // _CE low  (chip enabled)
-    eeprom_flags = R_W + _OE;
-    send_flags(eeprom_flags);
-    // Enable the data shift register's outputs
-    // by pulling its _OE pin low
-    P2OUT &= ~OE_DOUT;
+// chip command: display or select the EEPROM type from
+// chip_table
+void cmd_chip() {
+    char buf[72];
+    uint8_t idx;
 
-    if(eeprom_lock) {
-        // disable software data protection
-        for(uint16_t i=0; disable_data_protect[i][0] > 0; i++) {
-            // Set address and data
-            send_addr(disable_data_protect[i][0]);
-            send_data((char)(disable_data_protect[i][1] & 0xff));
-            // Strobe R_W pin
-            eeprom_flags &= ~R_W;
-            send_flags(eeprom_flags);
-            eeprom_flags |= R_W;
-            send_flags(eeprom_flags);
+    if(strlen(cmd) > 5) {
+        for(idx=0; chip_table[idx].name; idx++) {
+            if(strcmp(&cmd[5], chip_table[idx].name) == 0)
+                break;
+        }
+        if(!chip_table[idx].name) {
+            send_str("Invalid chip, expecting one of:");
+            for(idx=0; chip_table[idx].name; idx++) {
+                send_str(" ");
+                send_str(chip_table[idx].name);
+            }
+            send_str("\r\n");
+            return;
         }
+        sdp_relock();
+        chip = &chip_table[idx];
     }
 
-    // Enable write mode in the serial RX interrupt routine
-    serial_mode = SERMODE_WRITE;
+    sprintf(buf, "Chip %s: end %04x, page %u, tWC %ums%s%s\r\n", chip->name, chip->end,
+            chip->page, chip->twc, chip->lock ? ", SDP" : "", chip->erase ? ", chip erase" : "");
+    send_str(buf);
+}
 
-    while(cur_write_addr <= end_write_addr) {
-        // Figure out how many bytes we want this round
-        if(!page_write) {
-            write_buf_target_size = 1;
-        }
-        else {
-            len = 64 - (cur_write_addr % 64);
-            if(len == 0) len = 64; // start addr is on a boundary
-            if(cur_write_addr + len > end_write_addr)
-                write_buf_target_size = end_write_addr - cur_write_addr + 1;
-            else
-                write_buf_target_size = len;
-        }
-        
-        // Prompt the client to send that much data
-        sprintf(buf, "S %d/%u\r\n", write_buf_target_size, end_write_addr - cur_write_addr + 1);
+// unlock command: disable software data protection
+// until lock, or until the prompt has been idle for the
+// given number of seconds
+void cmd_unlock() {
+    char buf[48];
+    uint16_t seconds = RELOCK_DEFAULT;
+    char done = true;
+
+    if(strlen(cmd) > 7)
+        seconds = strtoul(&cmd[7], 0, 10);
+    if(seconds == 0 || seconds > RELOCK_MAX) {
+        sprintf(buf, "Invalid relock timeout: expecting 1 to %u\r\n", RELOCK_MAX);
         send_str(buf);
+        return;
+    }
+    if(!chip->unlock) {
+        sprintf(buf, "No SDP on %s\r\n", chip->name);
+        send_str(buf);
+        return;
+    }
 
-        // Reset write_buf_idx so new data arrives
-        // at beginning of write_buf
-        write_buf_idx = 0;
-
-        pause_for_char();
-
-        send_str("W\r\n");
-        for(int i=0; i<write_buf_idx; i++) {
-            // Set address and data
-            send_addr(cur_write_addr);
-            send_data(write_buf[i]);
-            // Strobe R_W pin
-            eeprom_flags &= ~R_W;
-            send_flags(eeprom_flags);
-            eeprom_flags |= R_W;
-            send_flags(eeprom_flags);
-
-            cur_write_addr++;
-        }
-        /* The serial interaction ("Send XX/YY") and the reading
-           of data from the serial port takes far longer than 10ms,
-           so this delay is unnecessary
-        __delay_cycles(200000); // 200k cycles @ 16MHz => 12.5ms
-        */
+    if(!sdp_unlocked) {
+        // write_begin() and write_end() leave SDP alone
+        // from here on
+        sdp_unlocked = true;
+        write_begin();
+        done = sdp_send(chip->unlock);
+        write_end();
     }
+    // Timer_A overflows about 31 times a second
+    relock_overflows = seconds * 31;
 
-    // ensure we wait at least 10ms after the last write cycle
-    __delay_cycles(200000); // 200k cycles @ 16MHz => 12.5ms
+    if(!done)
+        send_str("Write cycle timeout\r\n");
+    sprintf(buf, "Unlocked, relock after %us idle\r\n", seconds);
+    send_str(buf);
+}
 
-    // Disable write mode in the serial RX interrupt routine
-    serial_mode = SERMODE_CMD;
+// idle command: display or change the idle time before
+// LPM3 at the prompt
+void cmd_idle() {
+    char buf[48];
+    uint16_t seconds;
 
-    if(eeprom_lock) {
-        // enable software dsata protection
-        for(uint16_t i=0; enable_data_protect[i][0] > 0; i++) {
-            // Set address and data
-            send_addr(enable_data_protect[i][0]);
-            send_data((char)(enable_data_protect[i][1] & 0xff));
-            // Strobe R_W pin
-            eeprom_flags &= ~R_W;
-            send_flags(eeprom_flags);
-            eeprom_flags |= R_W;
-            send_flags(eeprom_flags);
-        }
+    if(strlen(cmd) <= 5) {
+        sprintf(buf, "Current idle setting: %us\r\n", idle_limit / 31);
+        send_str(buf);
+        return;
     }
 
-    // ensure we wait at least 10ms after the last write cycle
-    __delay_cycles(200000); // 200k cycles @ 16MHz => 12.5ms
-
-    // Disable the data shift register's outputs
-    // by pulling its _OE pin high
-    P2OUT |= OE_DOUT;
+    seconds = strtoul(&cmd[5], 0, 10);
+    if(seconds > IDLE_MAX || (seconds == 0 && cmd[5] != '0')) {
+        sprintf(buf, "Invalid idle time: expecting 0 to %u\r\n", IDLE_MAX);
+        send_str(buf);
+        return;
+    }
+    // Timer_A overflows about 31 times a second
+    idle_limit = seconds * 31;
+}
 
-    // Set the EEPROM flags to a known state
-    // R_W high (strobe low to write)
-    // _OE high (data pins are inputs)
-    // _CE low  (chip enabled)
-    eeprom_flags = R_W + _OE;
-    send_flags(eeprom_flags);
+// lock command: re-enable software data protection
+// after unlock
+void cmd_lock() {
+    if(!sdp_relock())
+        send_str("Write cycle timeout\r\n");
+    send_str("Locked\r\n");
 }
 
-// Serial data RX interrupt
-#pragma vector=USCIAB0RX_VECTOR
-__interrupt void USCI0RX_ISR(void) {
-    if(serial_mode == SERMODE_WRITE) {
-        write_buf[write_buf_idx] = UCA0RXBUF;
-        write_buf_idx++;
-        // once we have collected enough bytes, wake the CPU back up
-        if(write_buf_idx >= write_buf_target_size) {
-            __bic_SR_register_on_exit(LPM0_bits);
-        }
+// stats command: display the timing and byte counters,
+// or zero them with "stats reset"
+void cmd_stats() {
+    char buf[40];
+    uint32_t ticks[STAT_TIMES];
+    uint32_t count[STAT_COUNTS];
+    uint32_t elapsed;
+
+    if(strcmp(cmd, "stats reset") == 0) {
+        stats_reset();
+        return;
     }
-    else if(serial_mode == SERMODE_ECHO) {
-        if(echo_mode) echo(UCA0RXBUF);
-        __bic_SR_register_on_exit(LPM0_bits);
+
+    // Take a copy, so the reply doesn't count itself
+    __disable_interrupt();
+    elapsed = timer_now() - stat_reset_time;
+    memcpy(ticks, stat_ticks, sizeof(ticks));
+    memcpy(count, (uint32_t *)stat_count, sizeof(count));
+    __enable_interrupt();
+
+    sprintf(buf, "Elapsed: %lu us\r\n", elapsed / TICKS_PER_US);
+    send_str(buf);
+    for(uint8_t i=0; i<STAT_TIMES; i++) {
+        sprintf(buf, "%s: %lu us\r\n", stat_time_names[i], ticks[i] / TICKS_PER_US);
+        send_str(buf);
     }
-    else if(serial_mode == SERMODE_CMD) {
-        if(UCA0RXBUF == 0x0d) {
-            if(echo_mode) send_str("\r\n");
-            // when command is complete, wake the CPU back up
-            __bic_SR_register_on_exit(LPM0_bits);
-        }
-        else {
-            if(echo_mode) echo(UCA0RXBUF);
-            strncat(cmd, &UCA0RXBUF, 1);
-        }
+    for(uint8_t i=0; i<STAT_COUNTS; i++) {
+        sprintf(buf, "%s: %lu\r\n", stat_count_names[i], count[i]);
+        send_str(buf);
     }
 }
 
-// Echos a char back to the client
-void echo(char chr) {
-    char to_send[2];
-    to_send[0] = chr;
-    to_send[1] = 0x00;
-    send_str(to_send);
+// Zeroes the stats counters.  What follows includes the
+// prompt after "stats reset" and the "stats" command
+// that reads them back.
+void stats_reset() {
+    __disable_interrupt();
+    stat_reset_time = timer_now();
+    memset(stat_ticks, 0, sizeof(stat_ticks));
+    memset((uint32_t *)stat_count, 0, sizeof(stat_count));
+    __enable_interrupt();
 }
 
-// Sends a string to the client
-void send_str(char *str) {
-    char *ptr = str;
-    while(*ptr) {
-        while (!(IFG2 & UCA0TXIFG)); // USCI_A0 TX buffer ready?
-        UCA0TXBUF = *ptr;
-        ptr++;
-    }
+// Returns Timer_A ticks since power up, with the overflows
+// counted by TIMER0_A1_ISR as the high word
+uint32_t timer_now() {
+    uint16_t gie = __get_SR_register() & GIE;
+    uint16_t hi, lo;
+
+    __disable_interrupt();
+    hi = timer_overflows;
+    lo = TAR;
+    // TAR wrapped, but the ISR hasn't run yet
+    if((TACTL & TAIFG) && lo < 0x8000)
+        hi++;
+    if(gie)
+        __enable_interrupt();
+    return ((uint32_t)hi << 16) | lo;
 }
 
+// Parses "<name> 0xabcd 0xef01" in cmd into start and
+// end addresses.  Sends an error and returns false if the
+// command is malformed.
+char parse_range(char *name, uint16_t *start_addr, uint16_t *end_addr) {
+    char buf[64];
+    int len = strlen(cmd);
+    int name_len = strlen(name);
+
+    if(len != name_len + 14) {
+        sprintf(buf, "Invalid %s command: wrong length: %d, expecting %d\r\n", name, len, name_len + 14);
+        send_str(buf);
+        return false;
+    }
+    // read 0xabcd 0xef01
+    // 0      ^7     ^14
+    *start_addr = strtoul(&cmd[name_len + 3], 0, 16);
+    *end_addr = strtoul(&cmd[name_len + 10], 0, 16);
+    if(*start_addr == 0 && strncmp(&cmd[name_len + 3], "0000", 4) != 0) {
+        sprintf(buf, "Invalid %s command: cannot parse start addr\r\n", name);
+        send_str(buf);
+        return false;
+    }
+    if(*end_addr == 0 && strncmp(&cmd[name_len + 10], "0000", 4) != 0) {
+        sprintf(buf, "Invalid %s command: cannot parse end addr\r\n", name);
+        send_str(buf);
+        return false;
+    }
+    if(*start_addr > *end_addr) {
+        sprintf(buf, "Invalid %s command: start-addr > end-addr\r\n", name);
+        send_str(buf);
+        return false;
+    }
+    if(*end_addr > chip->end) {
+        sprintf(buf, "Invalid %s command: end-addr > %04x\r\n", name, chip->end);
+        send_str(buf);
+        return false;
+    }
+    return true;
+}
+
+// Parses the " 0xab" after "<name> 0xabcd 0xef01" in
+// cmd, and cuts it off so parse_range() sees just the
+// range.  Returns false if it isn't there.
+char parse_byte_arg(char *name, uint8_t *value) {
+    int pos = strlen(name) + 14;
+
+    if(strlen(cmd) != pos + 5 || cmd[pos] != ' ')
+        return false;
+    *value = strtoul(&cmd[pos + 1], 0, 16);
+    if(*value == 0 && strncmp(&cmd[pos + 1], "0x00", 4) != 0)
+        return false;
+    cmd[pos] = 0;
+    return true;
+}
+
+// Read command: read from EEPROM
+void cmd_read() {
+    uint16_t start_addr;
+    uint16_t end_addr;
+    uint8_t data_byte;
+    char buf[64];
+
+    if(!parse_range("read", &start_addr, &end_addr))
+        return;
+    sprintf(buf, "Start addr: %04x (%u)\r\n", start_addr, start_addr);
+    send_str(buf);
+    sprintf(buf, "End addr: %04x (%u)\r\n", end_addr, end_addr);
+    send_str(buf);
+    sprintf(buf, "Requesting %u bytes now...\r\n", end_addr - start_addr + 1);
+    send_str(buf);
+
+    read_begin();
+
+    // Iterate through each address
+    for(uint16_t i=start_addr; i<=end_addr; i++) {
+        data_byte = read_byte(i);
+
+        // Queue the hex digits; they go out while we
+        // clock in the next byte
+        if(echo_mode) {
+            send_byte(hex_digits[data_byte >> 4]);
+            send_byte(hex_digits[data_byte & 0x0f]);
+        }
+
+        // don't wrap around at the top of the address space
+        if(i == 0xffff)
+            break;
+    }
+
+    read_end();
+}
+
+// Binary read command: read from EEPROM and send raw
+// bytes, or run-length encoded bytes with rle on,
+// framed by a length header and a 16-bit sum
+void cmd_read_bin() {
+    uint16_t start_addr;
+    uint16_t end_addr;
+    uint16_t count;
+    uint16_t sum = 0;
+    uint8_t data_byte;
+    char *literal = write_buf[0];
+    uint8_t lit_len = 0;
+    uint8_t run_byte = 0;
+    uint8_t run_len = 0;
+
+    if(!parse_range("read_bin", &start_addr, &end_addr))
+        return;
+
+    // 'B' (or 'R'), then byte count, little-endian
+    count = end_addr - start_addr + 1;
+    send_byte(rle ? 'R' : 'B');
+    send_byte(count & 0xff);
+    send_byte(count >> 8);
+
+    read_begin();
+
+    for(uint16_t i=start_addr; i<=end_addr; i++) {
+        data_byte = read_byte(i);
+        sum += data_byte;
+        if(!rle) {
+            send_byte(data_byte);
+        }
+        else if(run_len > 0 && data_byte == run_byte && run_len < 129) {
+            run_len++;
+        }
+        else {
+            lit_len = rle_flush_run(literal, lit_len, run_byte, run_len);
+            run_byte = data_byte;
+            run_len = 1;
+        }
+
+        // don't wrap around at the top of the address space
+        if(i == 0xffff)
+            break;
+    }
+    if(rle) {
+        lit_len = rle_flush_run(literal, lit_len, run_byte, run_len);
+        rle_send_literal(literal, lit_len);
+    }
+
+    read_end();
+
+    // Trailing checksum, little-endian
+    send_byte(sum & 0xff);
+    send_byte(sum >> 8);
+}
+
+// Sends len copies of data, read by cmd_read_bin(), as
+// a repeat if that's shorter, or else adds them to the
+// literal staged in literal.  Returns the new length of
+// the staged literal.
+uint8_t rle_flush_run(char *literal, uint8_t lit_len, uint8_t data, uint8_t len) {
+    // A run of two only pays when it doesn't split a literal
+    if(len >= 3 || (len == 2 && lit_len == 0)) {
+        rle_send_literal(literal, lit_len);
+        send_byte(len + 0x7e);
+        send_byte(data);
+        return 0;
+    }
+    while(len--) {
+        literal[lit_len++] = data;
+        if(lit_len == RLE_LITERAL_MAX) {
+            rle_send_literal(literal, lit_len);
+            lit_len = 0;
+        }
+    }
+    return lit_len;
+}
+
+// Sends the len staged literal bytes with their header
+void rle_send_literal(char *literal, uint8_t len) {
+    if(len == 0)
+        return;
+    send_byte(len - 1);
+    for(uint8_t i=0; i<len; i++)
+        send_byte(literal[i]);
+}
+
+// CRC command: CRC-32 of an address range, so the
+// client can verify without reading the data back
+void cmd_crc() {
+    uint16_t start_addr;
+    uint16_t end_addr;
+    char buf[24];
+
+    if(!parse_range("crc", &start_addr, &end_addr))
+        return;
+
+    sprintf(buf, "CRC %08lx\r\n", crc_range(start_addr, end_addr));
+    send_str(buf);
+}
+
+// Returns the CRC-32 of the bytes from start_addr to
+// end_addr, inclusive
+uint32_t crc_range(uint16_t start_addr, uint16_t end_addr) {
+    uint32_t crc = 0xffffffff;
+
+    read_begin();
+    for(uint16_t i=start_addr; i<=end_addr; i++) {
+        crc = crc32_update(crc, read_byte(i));
+
+        // don't wrap around at the top of the address space
+        if(i == 0xffff)
+            break;
+    }
+    read_end();
+    return crc ^ 0xffffffff;
+}
+
+// Pagehash command: a short hash of every page in an
+// address range, so the client can find which pages
+// differ without reading them back
+void cmd_pagehash() {
+    uint16_t start_addr;
+    uint16_t end_addr;
+    uint16_t addr;
+    uint16_t len;
+    uint16_t hash;
+    uint32_t crc;
+    char buf[24];
+
+    if(!parse_range("pagehash", &start_addr, &end_addr))
+        return;
+
+    // Pages are split the same way as a paged write: the
+    // first and last may be partial
+    len = (end_addr / chip->page) - (start_addr / chip->page) + 1;
+    sprintf(buf, "Hashes %u\r\n", len);
+    send_str(buf);
+
+    read_begin();
+    addr = start_addr;
+    while(1) {
+        len = chip->page - (addr % chip->page);
+        if(len > end_addr - addr + 1)
+            len = end_addr - addr + 1;
+
+        crc = 0xffffffff;
+        for(uint16_t i=0; i<len; i++)
+            crc = crc32_update(crc, read_byte(addr + i));
+        hash = (crc ^ 0xffffffff) & 0xffff;
+        send_byte(hex_digits[hash >> 12]);
+        send_byte(hex_digits[(hash >> 8) & 0x0f]);
+        send_byte(hex_digits[(hash >> 4) & 0x0f]);
+        send_byte(hex_digits[hash & 0x0f]);
+
+        // stop at end_addr, without wrapping past 0xffff
+        if(end_addr - addr < len)
+            break;
+        addr += len;
+    }
+    read_end();
+    send_str("\r\n");
+}
+
+// Blank command: check that a range holds one value,
+// and report the first address that doesn't
+void cmd_blank() {
+    uint16_t start_addr;
+    uint16_t end_addr;
+    uint8_t value = 0xff;
+    uint16_t bad_addr;
+    uint8_t bad_data;
+    char buf[32];
+
+    // The value is optional
+    if(strlen(cmd) != strlen("blank") + 14 && !parse_byte_arg("blank", &value)) {
+        send_str("Invalid blank command: expecting blank 0xabcd 0xef01 [0xff]\r\n");
+        return;
+    }
+    if(!parse_range("blank", &start_addr, &end_addr))
+        return;
+
+    if(check_blank(start_addr, end_addr, value, &bad_addr, &bad_data)) {
+        send_str("Blank\r\n");
+    }
+    else {
+        sprintf(buf, "Mismatch at %04x: %02x\r\n", bad_addr, bad_data);
+        send_str(buf);
+    }
+}
+
+// Returns true if every byte from start_addr to end_addr
+// of read_socket holds value, or else false with the
+// first that doesn't in bad_addr and bad_data
+char check_blank(uint16_t start_addr, uint16_t end_addr, uint8_t value, uint16_t *bad_addr, uint8_t *bad_data) {
+    uint8_t data_byte;
+
+    read_begin();
+    for(uint16_t i=start_addr; i<=end_addr; i++) {
+        data_byte = read_byte(i);
+        if(data_byte != value) {
+            read_end();
+            *bad_addr = i;
+            *bad_data = data_byte;
+            return false;
+        }
+
+        // don't wrap around at the top of the address space
+        if(i == 0xffff)
+            break;
+    }
+    read_end();
+    return true;
+}
+
+// check_blank() of the whole part, with 0xff, on every
+// socket in gang_mask
+char gang_blank(uint16_t *bad_addr, uint8_t *bad_data) {
+    uint8_t socket = read_socket;
+    char blank = true;
+
+    for(read_socket=0; read_socket<SOCKETS && blank; read_socket++) {
+        if(gang_mask & (1 << read_socket))
+            blank = check_blank(0x0000, chip->end, 0xff, bad_addr, bad_data);
+    }
+    read_socket = socket;
+    return blank;
+}
+
+// Chip erase command: erase the whole part with the
+// chip erase sequence, or by filling it with 0xff
+void cmd_chip_erase() {
+    uint16_t bad_addr;
+    uint8_t bad_data;
+    char buf[32];
+    uint32_t start;
+
+    if(strcmp(cmd, "chip_erase fill") != 0 && chip->erase) {
+        write_begin();
+        for(uint16_t i=0; chip->erase[i][0] > 0; i++)
+            write_byte(chip->erase[i][0], chip->erase[i][1] & 0xff);
+        // tEC is up to 20ms
+        start = timer_now();
+        for(uint8_t i=0; i<25; i++)
+            __delay_cycles(16000); // 16000 cycles @ 16MHz => 1ms
+        stat_ticks[STAT_TWC] += timer_now() - start;
+        write_end();
+        if(gang_blank(&bad_addr, &bad_data)) {
+            send_str("Erased\r\n");
+            return;
+        }
+    }
+
+    // No chip erase on this part: fill it instead
+    send_str("Filling\r\n");
+    cur_write_addr = 0x0000;
+    end_write_addr = chip->end;
+    fill_range(0xff, true);
+    write_report();
+    send_str("\r\n");
+
+    if(gang_blank(&bad_addr, &bad_data)) {
+        send_str("Erased\r\n");
+    }
+    else {
+        sprintf(buf, "Mismatch at %04x: %02x\r\n", bad_addr, bad_data);
+        send_str(buf);
+    }
+}
+
+// Adds one byte to a running CRC-32.  Start with
+// 0xffffffff and invert the final value.
+uint32_t crc32_update(uint32_t crc, uint8_t data) {
+    crc ^= data;
+    crc = (crc >> 4) ^ crc32_nibble[crc & 0x0f];
+    crc = (crc >> 4) ^ crc32_nibble[crc & 0x0f];
+    return crc;
+}
+
+// Prepares the EEPROM and data-in shift register for reads
+void read_begin() {
+    // Disable the data write shift register's outputs
+    // by pulling its _OE pin high
+    P2OUT |= OE_DOUT;
+    // Set the EEPROM flags to a known state
+    // R_W high (strobe low to write)
+    // _OE low  (data pins are outputs)
+    // _CE low  (read_socket enabled)
+    eeprom_flags = R_W + ce_flags(1 << read_socket);
+    send_flags(eeprom_flags);
+
+    // Set the shift register's pins to known states
+    P2OUT &= ~DIN_CLK;
+    P2OUT |= DIN_SHLD;
+}
+
+// Reads one byte from the EEPROM.  read_begin() must
+// have been called first.
+uint8_t read_byte(uint16_t addr) {
+    stat_count[STAT_READS]++;
+    // Set the address
+    send_addr(addr);
+    return sample_data();
+}
+
+#ifdef BOARD_PARALLEL_DIN
+// Reads the EEPROM data bus from port 3
+uint8_t sample_data() {
+    // Give the EEPROM its access time after the address
+    // or ~OE change: tACC is up to 250ns
+    __delay_cycles(6); // 6 cycles @ 16MHz => 375ns
+    return P3IN;
+}
+#else
+// Loads the EEPROM data bus into the data-in shift
+// register and clocks it out
+uint8_t sample_data() {
+    uint8_t data_byte;
+    uint8_t mask;
+
+    // Strobe the SH/~LD pin and strobe the clock to load the byte
+    P2OUT &= ~DIN_SHLD;
+    P2OUT |= DIN_CLK;
+    P2OUT &= ~DIN_CLK;
+    P2OUT |= DIN_SHLD;
+
+    // the LSB of the EEPROM data is now on QH
+    data_byte = 0x00;
+    mask = 0x01;
+    while(1) {
+        if(P2IN & DIN_QH)
+            data_byte |= mask;
+        if(mask >= 0x80)
+            break;
+        mask = (mask << 1);
+        // Shift bits on rising clock edge
+        P2OUT |= DIN_CLK;
+        P2OUT &= ~DIN_CLK;
+    }
+    return data_byte;
+}
+#endif
+
+// Returns the EEPROM to its idle state after reads
+void read_end() {
+    // Set the EEPROM flags to a known state
+    // R_W high (strobe low to write)
+    // _OE high (data pins are inputs)
+    // _CE low  (read_socket enabled)
+    eeprom_flags = R_W + _OE + ce_flags(1 << read_socket);
+    send_flags(eeprom_flags);
+}
+
+// Sends the write command banner shared by write
+// and write_stream
+void write_banner() {
+    char buf[64];
+
+    sprintf(buf, "Start addr: %04x (%u)\r\n", cur_write_addr, cur_write_addr);
+    send_str(buf);
+    sprintf(buf, "End addr: %04x (%u)\r\n", end_write_addr, end_write_addr);
+    send_str(buf);
+    sprintf(buf, "Total bytes to write: %u\r\n", end_write_addr - cur_write_addr + 1);
+    send_str(buf);
+    if(page_write)
+        send_str("Paging\r\n");
+    else
+        send_str("No Paging\r\n");
+    if(eeprom_lock)
+        send_str("EEPROM Lock Enabled\r\n");
+    else
+        send_str("EEPROM Lock Disabled\n");
+}
+
+// Returns how many bytes to write in one go starting
+// at addr, given that remaining bytes are left
+uint16_t page_len(uint16_t addr, uint16_t remaining) {
+    uint16_t len;
+
+    if(remaining == 0)
+        return 0;
+    if(!page_write)
+        return 1;
+    len = chip->page - (addr % chip->page);
+    if(len > remaining)
+        len = remaining;
+    return len;
+}
+
+// Prepares the EEPROM and data-out shift register for
+// writes, and disables software data protection if
+// eeprom_lock is enabled
+void write_begin() {
+    // Set the EEPROM flags to a known state
+    // R_W high (strobe low to write)
+    // _OE high (data pins are inputs)
+    // _CE low  (gang_mask sockets enabled)
+    eeprom_flags = R_W + _OE + ce_flags(gang_mask);
+    send_flags(eeprom_flags);
+    // Enable the data shift register's outputs
+    // by pulling its _OE pin low
+    P2OUT &= ~OE_DOUT;
+
+    // disable software data protection, unless unlock
+    // already has
+    if(eeprom_lock && chip->unlock && !sdp_unlocked)
+        sdp_send(chip->unlock);
+    write_timeouts = 0;
+    sockets_timed_out = 0;
+    pages_skipped = 0;
+}
+
+// Re-enables software data protection if eeprom_lock
+// is enabled, and returns the EEPROM to its idle state
+void write_end() {
+    // enable software data protection, unless unlock is
+    // holding it off
+    if(eeprom_lock && chip->lock && !sdp_unlocked)
+        sdp_send(chip->lock);
+
+    // Disable the data shift register's outputs
+    // by pulling its _OE pin high
+    P2OUT |= OE_DOUT;
+
+    // Set the EEPROM flags to a known state
+    // R_W high (strobe low to write)
+    // _OE high (data pins are inputs)
+    // _CE low  (gang_mask sockets enabled)
+    eeprom_flags = R_W + _OE + ce_flags(gang_mask);
+    send_flags(eeprom_flags);
+}
+
+// Sends an SDP sequence to the gang_mask sockets and
+// waits out its write cycle.  write_begin() must have
+// been called first.  Returns false on a timeout.
+char sdp_send(const uint16_t (*seq)[2]) {
+    for(uint16_t i=0; seq[i][0] > 0; i++)
+        write_byte(seq[i][0], seq[i][1] & 0xff);
+    return wait_toggle_bit(seq[0][0]);
+}
+
+// Re-enables software data protection if unlock is
+// holding it off.  Returns false on a write cycle
+// timeout.
+char sdp_relock() {
+    char done;
+
+    if(!sdp_unlocked)
+        return true;
+    write_begin();
+    done = sdp_send(chip->lock);
+    write_end();
+    sdp_unlocked = false;
+    return done;
+}
+
+// Reports the write cycle timeouts and skipped pages
+// once write_end() has been called
+void write_report() {
+    char buf[48];
+
+    if(write_timeouts) {
+        sprintf(buf, "Write cycle timeout: %u\r\n", write_timeouts);
+        send_str(buf);
+#ifdef BOARD_GANG
+        sprintf(buf, "Timed out sockets: 0x%02x\r\n", sockets_timed_out);
+        send_str(buf);
+#endif
+    }
+    if(diff_write) {
+        sprintf(buf, "Unchanged pages skipped: %u\r\n", pages_skipped);
+        send_str(buf);
+    }
+}
+
+// Returns true if every socket in gang_mask already
+// holds the len bytes of buf at addr.  Used by
+// diff_write to skip the page load and tWC.
+char page_matches(uint16_t addr, char *buf, uint16_t len) {
+    char match = true;
+
+    // Release the data bus and read it back, one
+    // socket at a time
+    P2OUT |= OE_DOUT;
+    for(uint8_t s=0; s<SOCKETS && match; s++) {
+        if(!(gang_mask & (1 << s)))
+            continue;
+        select_sockets(1 << s);
+        EEPROM_OE_LOW();
+        for(uint16_t i=0; i<len; i++) {
+            if(read_byte(addr + i) != (uint8_t)buf[i]) {
+                match = false;
+                break;
+            }
+        }
+        EEPROM_OE_HIGH();
+    }
+    select_sockets(gang_mask);
+    P2OUT &= ~OE_DOUT;
+
+    return match;
+}
+
+// Adds the len bytes at addr, as now held by each socket
+// in gang_mask, to that socket's readback_crc
+void readback_page(uint16_t addr, uint16_t len) {
+    P2OUT |= OE_DOUT;
+    for(uint8_t s=0; s<SOCKETS; s++) {
+        if(!(gang_mask & (1 << s)))
+            continue;
+        select_sockets(1 << s);
+        EEPROM_OE_LOW();
+        for(uint16_t i=0; i<len; i++)
+            readback_crc[s] = crc32_update(readback_crc[s], read_byte(addr + i));
+        EEPROM_OE_HIGH();
+    }
+    select_sockets(gang_mask);
+    P2OUT &= ~OE_DOUT;
+}
+
+// Reads one byte at addr in the middle of a write,
+// pulsing the EEPROM's ~OE so each call is a new read
+// cycle.  The data-out shift register must not be
+// driving the bus.
+uint8_t poll_byte(uint16_t addr) {
+    uint8_t data_byte;
+
+    send_addr(addr);
+    EEPROM_OE_LOW();
+    data_byte = sample_data();
+    EEPROM_OE_HIGH();
+    return data_byte;
+}
+
+// Waits for the write cycle started by writing data
+// to addr, on each socket in gang_mask in turn.  Only
+// the socket being polled has ~CE low, so one part
+// drives the bus.  Returns false, and counts a
+// write_timeout, if any socket is still busy
+// POLL_TIMEOUT after the wait began.  The sockets' write
+// cycles run at once, so they share the one deadline.
+char wait_data_polling(uint16_t addr, uint8_t data) {
+    char done = true;
+    uint32_t start = timer_now();
+
+    // Let the byte load window (tBLC, 150us) close so the
+    // write cycle has started, then release the data bus
+    // so the EEPROM can drive it
+    __delay_cycles(3200); // 3200 cycles @ 16MHz => 200us
+    P2OUT |= OE_DOUT;
+    for(uint8_t s=0; s<SOCKETS; s++) {
+        if(!(gang_mask & (1 << s)))
+            continue;
+        select_sockets(1 << s);
+        if(!poll_data(addr, data, start)) {
+            sockets_timed_out |= (1 << s);
+            done = false;
+        }
+    }
+    select_sockets(gang_mask);
+    // Drive the data bus again
+    P2OUT &= ~OE_DOUT;
+
+    if(!done)
+        write_timeouts++;
+    stat_ticks[STAT_TWC] += timer_now() - start;
+    return done;
+}
+
+// Waits for a write cycle where the data is not known
+// (e.g. the SDP sequences), socket by socket as above
+char wait_toggle_bit(uint16_t addr) {
+    char done = true;
+    uint32_t start = timer_now();
+
+    __delay_cycles(3200); // 3200 cycles @ 16MHz => 200us, see above
+    P2OUT |= OE_DOUT;
+    for(uint8_t s=0; s<SOCKETS; s++) {
+        if(!(gang_mask & (1 << s)))
+            continue;
+        select_sockets(1 << s);
+        if(!poll_toggle(addr, start)) {
+            sockets_timed_out |= (1 << s);
+            done = false;
+        }
+    }
+    select_sockets(gang_mask);
+    P2OUT &= ~OE_DOUT;
+
+    if(!done)
+        write_timeouts++;
+    stat_ticks[STAT_TWC] += timer_now() - start;
+    return done;
+}
+
+// Polls the selected socket until I/O7 at addr stops
+// reading back as the complement of data's top bit
+// (DATA# polling).  Returns false once POLL_TIMEOUT has
+// passed since start, a timer_now() reading.
+char poll_data(uint16_t addr, uint8_t data, uint32_t start) {
+    while(timer_now() - start < POLL_TIMEOUT) {
+        if(((poll_byte(addr) ^ data) & 0x80) == 0)
+            return true;
+        __delay_cycles(160); // 160 cycles @ 16MHz => 10us
+    }
+    return false;
+}
+
+// Polls the selected socket until I/O6 stops toggling
+// on every read (toggle bit).  Returns false once
+// POLL_TIMEOUT has passed since start, as above.
+char poll_toggle(uint16_t addr, uint32_t start) {
+    uint8_t last;
+
+    last = poll_byte(addr);
+    while(timer_now() - start < POLL_TIMEOUT) {
+        uint8_t cur = poll_byte(addr);
+        if(((cur ^ last) & 0x40) == 0)
+            return true;
+        last = cur;
+        __delay_cycles(160); // 160 cycles @ 16MHz => 10us
+    }
+    return false;
+}
+
+// Writes one byte: sets address and data, and strobes
+// R_W.  write_begin() must have been called first.
+void write_byte(uint16_t addr, uint8_t data) {
+    stat_count[STAT_WRITES]++;
+    // Set address and data
+    send_addr(addr);
+    send_data(data);
+    // Strobe R_W pin
+    EEPROM_WE_STROBE();
+}
+
+// Writes len bytes from buf starting at addr, as one
+// page load burst.  The caller waits out tWC.
+void write_page(uint16_t addr, char *buf, uint16_t len) {
+    for(uint16_t i=0; i<len; i++)
+        write_byte(addr + i, buf[i]);
+}
+
+// Write command: write to EEPROM
+void cmd_write() {
+    char buf[64];
+
+    if(!parse_range("write", &cur_write_addr, &end_write_addr))
+        return;
+    write_banner();
+    write_begin();
+
+    // Enable write mode in the serial RX interrupt routine
+    serial_mode = SERMODE_WRITE;
+
+    while(cur_write_addr <= end_write_addr) {
+        // Figure out how many bytes we want this round
+        write_buf_target_size = page_len(cur_write_addr, end_write_addr - cur_write_addr + 1);
+
+        // Prompt the client to send that much data
+        sprintf(buf, "S %d/%u\r\n", write_buf_target_size, end_write_addr - cur_write_addr + 1);
+        send_str(buf);
+
+        // Reset write_buf_idx so new data arrives
+        // at beginning of write_buf
+        write_buf_idx = 0;
+        rle_literal = 0;
+        rle_repeat = 0;
+
+        pause_for_char();
+
+        send_str("W\r\n");
+        if(diff_write && page_matches(cur_write_addr, write_buf[0], write_buf_idx)) {
+            pages_skipped++;
+            cur_write_addr += write_buf_idx;
+        }
+        else {
+            write_page(cur_write_addr, write_buf[0], write_buf_idx);
+            cur_write_addr += write_buf_idx;
+            // At higher baud rates the next "S n/m" round trip
+            // can be shorter than tWC, so wait for the part
+            wait_data_polling(cur_write_addr - 1, write_buf[0][write_buf_idx - 1]);
+        }
+        if(cur_write_addr == 0)
+            break; // wrapped past 0xffff
+    }
+
+    // Disable write mode in the serial RX interrupt routine
+    serial_mode = SERMODE_CMD;
+
+    write_end();
+    write_report();
+}
+
+// Streaming write command: like write, but the client
+// sends pages against a credit of WRITE_BUFS pages rather
+// than waiting for a prompt.  The RX ISR fills one
+// write_buf while we program another.
+void cmd_write_stream() {
+    char buf[32];
+    uint16_t remaining;
+    uint8_t prog = 0;
+    uint8_t last_data;
+    uint8_t len;
+    uint32_t start;
+
+    if(!parse_range("write_stream", &cur_write_addr, &end_write_addr))
+        return;
+    write_banner();
+    write_begin();
+
+    // Set up the RX ISR to fill write_buf[0] with the first page
+    remaining = end_write_addr - cur_write_addr + 1;
+    stream_fill = 0;
+    for(uint8_t i=0; i<WRITE_BUFS; i++)
+        stream_full[i] = false;
+    stream_overrun = false;
+    stream_rx_addr = cur_write_addr;
+    stream_rx_remaining = remaining;
+    write_buf_idx = 0;
+    rle_literal = 0;
+    rle_repeat = 0;
+    write_buf_target_size = page_len(stream_rx_addr, stream_rx_remaining);
+    for(uint8_t s=0; s<SOCKETS; s++)
+        readback_crc[s] = 0xffffffff;
+    serial_mode = SERMODE_STREAM;
+
+    // Grant the client one page of credit per buffer
+    IE2 |= UCA0RXIE;
+    sprintf(buf, "Credit %d\r\n", WRITE_BUFS);
+    send_str(buf);
+
+    while(remaining > 0) {
+        // Sleep until the RX ISR has filled this buffer
+        start = timer_now();
+        __disable_interrupt();
+        while(!stream_full[prog]) {
+            __bis_SR_register(LPM0_bits + GIE);
+            __disable_interrupt();
+        }
+        __enable_interrupt();
+        stat_ticks[STAT_HOST] += timer_now() - start;
+
+        len = stream_len[prog];
+        if(diff_write && page_matches(cur_write_addr, write_buf[prog], len)) {
+            // Already programmed: no page load, no tWC
+            pages_skipped++;
+            cur_write_addr += len;
+            remaining -= len;
+            stream_full[prog] = false;
+            send_byte('W');
+            prog = (prog + 1) % WRITE_BUFS;
+            if(readback)
+                readback_page(cur_write_addr - len, len);
+            continue;
+        }
+
+        write_page(cur_write_addr, write_buf[prog], len);
+        cur_write_addr += len;
+        remaining -= len;
+        last_data = write_buf[prog][len - 1];
+
+        // The page is in the EEPROM's page latch, so the
+        // buffer is free: hand it back to the RX ISR and
+        // return the credit before waiting out tWC
+        stream_full[prog] = false;
+        send_byte('W');
+        prog = (prog + 1) % WRITE_BUFS;
+
+        // wait out tWC while the next page arrives, and
+        // read the page back once it's written
+        wait_data_polling(cur_write_addr - 1, last_data);
+        if(readback)
+            readback_page(cur_write_addr - len, len);
+    }
+
+    IE2 &= ~UCA0RXIE;
+    serial_mode = SERMODE_CMD;
+
+    write_end();
+    write_report();
+
+    send_str("\r\n");
+    if(stream_overrun)
+        send_str("Overrun: client exceeded its credit\r\n");
+    for(uint8_t s=0; readback && s<SOCKETS; s++) {
+        if(!(gang_mask & (1 << s)))
+            continue;
+        sprintf(buf, "Readback CRC %u %08lx\r\n", s, readback_crc[s] ^ 0xffffffff);
+        send_str(buf);
+    }
+}
+
+// Fill command: write one value over a range, with
+// no data from the client
+void cmd_fill() {
+    uint8_t value;
+
+    if(!parse_byte_arg("fill", &value)) {
+        send_str("Invalid fill command: expecting fill 0xabcd 0xef01 0xff\r\n");
+        return;
+    }
+    if(!parse_range("fill", &cur_write_addr, &end_write_addr))
+        return;
+    write_banner();
+    fill_range(value, true);
+    write_report();
+    send_str("\r\n");
+}
+
+// Writes value from cur_write_addr to end_write_addr,
+// sending a 'W' per page if acks is set
+void fill_range(uint8_t value, char acks) {
+    uint16_t len;
+
+    write_begin();
+
+    memset(write_buf[0], value, PAGE_MAX);
+    while(cur_write_addr <= end_write_addr) {
+        len = page_len(cur_write_addr, end_write_addr - cur_write_addr + 1);
+        if(diff_write && page_matches(cur_write_addr, write_buf[0], len)) {
+            pages_skipped++;
+        }
+        else {
+            write_page(cur_write_addr, write_buf[0], len);
+            wait_data_polling(cur_write_addr + len - 1, value);
+        }
+        if(acks)
+            send_byte('W');
+        cur_write_addr += len;
+        if(cur_write_addr == 0)
+            break; // wrapped past 0xffff
+    }
+
+    write_end();
+}
+
+// Batch command: collects a list of segments, each an
+// address, a length and the data, and writes them back to
+// back without a prompt per page
+void cmd_batch() {
+    char buf[48];
+    uint8_t *list = (uint8_t *)write_buf;
+    uint16_t len, pos, segments, loads;
+    char saved_rle = rle;
+
+    len = strtoul(&cmd[6], 0, 10);
+    if(strlen(cmd) <= 6 || len == 0 || len > BATCH_MAX) {
+        sprintf(buf, "Invalid batch length: expecting 1 to %u\r\n", BATCH_MAX);
+        send_str(buf);
+        return;
+    }
+    sprintf(buf, "Batch %u\r\n", len);
+    send_str(buf);
+
+    // Collect the whole list before writing anything.  It
+    // is never run-length encoded.
+    rle = false;
+    write_buf_idx = 0;
+    write_buf_target_size = len;
+    serial_mode = SERMODE_WRITE;
+    pause_for_char();
+    serial_mode = SERMODE_CMD;
+    rle = saved_rle;
+
+    segments = 0;
+    for(pos=0; pos<len; pos += list[pos + 2] + 3) {
+        if(pos + 3 > len || list[pos + 2] == 0 || pos + 3 + list[pos + 2] > len
+                || (list[pos] | (list[pos + 1] << 8)) > chip->end - (list[pos + 2] - 1)) {
+            sprintf(buf, "Invalid batch list at byte %u\r\n", pos);
+            send_str(buf);
+            return;
+        }
+        segments++;
+    }
+
+    loads = batch_write(list, len);
+    sprintf(buf, "Segments %u, page loads %u\r\n", segments, loads);
+    send_str(buf);
+    write_report();
+}
+
+// Writes the segments in a batch list of len bytes.
+// Consecutive bytes in the same page are loaded back to
+// back, within tBLC, so they share one write cycle.
+// Returns the number of page loads.
+uint16_t batch_write(uint8_t *list, uint16_t len) {
+    uint16_t addr, last_addr = 0, loads = 0;
+    uint8_t n, last_data = 0;
+    char loading = false;
+
+    write_begin();
+    for(uint16_t pos=0; pos<len; pos += n) {
+        addr = list[pos] | (list[pos + 1] << 8);
+        n = list[pos + 2];
+        pos += 3;
+        for(uint8_t i=0; i<n; i++, addr++) {
+            // A new page, or with page_write off any byte,
+            // ends the load: wait out tWC on its last byte
+            if(loading && (!page_write || addr / chip->page != last_addr / chip->page)) {
+                wait_data_polling(last_addr, last_data);
+                loading = false;
+            }
+            if(!loading) {
+                loads++;
+                loading = true;
+            }
+            last_addr = addr;
+            last_data = list[pos + i];
+            write_byte(addr, last_data);
+        }
+    }
+    if(loading)
+        wait_data_polling(last_addr, last_data);
+    write_end();
+
+    return loads;
+}
+
+// Binary command: runs the frame the RX ISR collected
+// in cmd, and replies with a binary frame
+void cmd_binary() {
+    uint8_t *frame = (uint8_t *)cmd;
+    uint8_t len = frame[1];
+    uint8_t *arg = &frame[2];
+    uint8_t crc = 0;
+    uint16_t start_addr;
+    uint16_t end_addr;
+    uint16_t bad_addr;
+    uint8_t bad_data;
+    uint8_t reply[4];
+    uint32_t crc32;
+
+    if(bin_idx < 3 || len > BIN_PAYLOAD_MAX) {
+        bin_reply(ST_BAD_FRAME, 0, 0);
+        return;
+    }
+    for(uint8_t i=0; i<len+2; i++)
+        crc = crc8_update(crc, frame[i]);
+    if(crc != frame[len + 2]) {
+        bin_reply(ST_BAD_FRAME, 0, 0);
+        return;
+    }
+
+    // Most opcodes start with an address range
+    start_addr = arg[0] | (arg[1] << 8);
+    end_addr = arg[2] | (arg[3] << 8);
+
+    switch(frame[0]) {
+        case OP_NOP:
+            bin_reply(ST_OK, 0, 0);
+            break;
+        case OP_READ:
+            if(len != 4 || start_addr > end_addr || end_addr > chip->end) {
+                bin_reply(ST_BAD_ARGS, 0, 0);
+                break;
+            }
+            bin_reply_begin(ST_OK, end_addr - start_addr + 1);
+            read_begin();
+            for(uint16_t i=start_addr; i<=end_addr; i++) {
+                bin_reply_byte(read_byte(i));
+
+                // don't wrap around at the top of the address space
+                if(i == 0xffff)
+                    break;
+            }
+            read_end();
+            bin_reply_end();
+            break;
+        case OP_WRITE:
+            if(len < 3 || start_addr > chip->end || (uint16_t)(len - 3) > chip->end - start_addr) {
+                bin_reply(ST_BAD_ARGS, 0, 0);
+                break;
+            }
+            // The data is in cmd, so no serial mode change
+            cur_write_addr = start_addr;
+            end_write_addr = start_addr + len - 3;
+            write_begin();
+            for(uint8_t i=0; i<len-2; ) {
+                uint16_t n = page_len(cur_write_addr, len - 2 - i);
+                if(diff_write && page_matches(cur_write_addr, (char *)&arg[2 + i], n)) {
+                    pages_skipped++;
+                }
+                else {
+                    write_page(cur_write_addr, (char *)&arg[2 + i], n);
+                    wait_data_polling(cur_write_addr + n - 1, arg[2 + i + n - 1]);
+                }
+                cur_write_addr += n;
+                i += n;
+            }
+            write_end();
+            bin_write_status();
+            break;
+        case OP_CRC:
+            if(len != 4 || start_addr > end_addr || end_addr > chip->end) {
+                bin_reply(ST_BAD_ARGS, 0, 0);
+                break;
+            }
+            crc32 = crc_range(start_addr, end_addr);
+            for(uint8_t i=0; i<4; i++)
+                reply[i] = crc32 >> (8 * i);
+            bin_reply(ST_OK, reply, 4);
+            break;
+        case OP_BLANK:
+            if(len != 5 || start_addr > end_addr || end_addr > chip->end) {
+                bin_reply(ST_BAD_ARGS, 0, 0);
+                break;
+            }
+            if(check_blank(start_addr, end_addr, arg[4], &bad_addr, &bad_data)) {
+                bin_reply(ST_OK, 0, 0);
+                break;
+            }
+            reply[0] = bad_addr & 0xff;
+            reply[1] = bad_addr >> 8;
+            reply[2] = bad_data;
+            bin_reply(ST_MISMATCH, reply, 3);
+            break;
+        case OP_FILL:
+            if(len != 5 || start_addr > end_addr || end_addr > chip->end) {
+                bin_reply(ST_BAD_ARGS, 0, 0);
+                break;
+            }
+            cur_write_addr = start_addr;
+            end_write_addr = end_addr;
+            fill_range(arg[4], false);
+            bin_write_status();
+            break;
+        case OP_SET:
+            if(len != 2) {
+                bin_reply(ST_BAD_ARGS, 0, 0);
+                break;
+            }
+            switch(arg[0]) {
+                case 0: echo_mode = arg[1] != 0; break;
+                case 1: page_write = arg[1] != 0; break;
+                case 2: eeprom_lock = arg[1] != 0; break;
+                case 3: diff_write = arg[1] != 0; break;
+                case 4: rle = arg[1] != 0; break;
+                case 5:
+                    if(arg[1] == 0 || arg[1] >= (1 << SOCKETS)) {
+                        bin_reply(ST_BAD_ARGS, 0, 0);
+                        return;
+                    }
+                    sdp_relock();
+                    gang_mask = arg[1];
+                    break;
+                case 6:
+                    if(arg[1] >= SOCKETS) {
+                        bin_reply(ST_BAD_ARGS, 0, 0);
+                        return;
+                    }
+                    read_socket = arg[1];
+                    break;
+                default:
+                    bin_reply(ST_BAD_ARGS, 0, 0);
+                    return;
+            }
+            bin_reply(ST_OK, 0, 0);
+            break;
+        default:
+            bin_reply(ST_BAD_OP, 0, 0);
+            break;
+    }
+}
+
+// Starts a binary reply with len bytes of payload
+void bin_reply_begin(uint8_t status, uint16_t len) {
+    send_byte(BIN_REPLY);
+    bin_crc = 0;
+    bin_reply_byte(status);
+    bin_reply_byte(len & 0xff);
+    bin_reply_byte(len >> 8);
+}
+
+// Sends one byte of a binary reply
+void bin_reply_byte(uint8_t data) {
+    send_byte(data);
+    bin_crc = crc8_update(bin_crc, data);
+}
+
+// Ends a binary reply with its crc8
+void bin_reply_end() {
+    send_byte(bin_crc);
+}
+
+// Sends a whole binary reply with a short payload
+void bin_reply(uint8_t status, uint8_t *payload, uint8_t len) {
+    bin_reply_begin(status, len);
+    for(uint8_t i=0; i<len; i++)
+        bin_reply_byte(payload[i]);
+    bin_reply_end();
+}
+
+// Replies to a binary write or fill with the write
+// cycle timeout and skipped page counts
+void bin_write_status() {
+    uint8_t reply[4];
+
+    reply[0] = write_timeouts & 0xff;
+    reply[1] = write_timeouts >> 8;
+    reply[2] = pages_skipped & 0xff;
+    reply[3] = pages_skipped >> 8;
+    bin_reply(write_timeouts ? ST_TIMEOUT : ST_OK, reply, 4);
+}
+
+// Adds one byte to a running CRC-8.  Start with 0.
+uint8_t crc8_update(uint8_t crc, uint8_t data) {
+    crc ^= data;
+    crc = (crc << 4) ^ crc8_nibble[crc >> 4];
+    crc = (crc << 4) ^ crc8_nibble[crc >> 4];
+    return crc;
+}
+
+// Stores one byte of page data from the client at
+// page[write_buf_idx], decoding it first if rle is on.
+// Called from USCI0RX_ISR.
+void rx_store(char *page, uint8_t data) {
+    uint8_t count;
+
+    // never run past the end of the page
+    if(!rle || rle_literal) {
+        if(write_buf_idx < write_buf_target_size)
+            page[write_buf_idx++] = data;
+        if(rle_literal)
+            rle_literal--;
+    }
+    else if(rle_repeat) {
+        count = rle_repeat;
+        rle_repeat = 0;
+        while(count-- && write_buf_idx < write_buf_target_size)
+            page[write_buf_idx++] = data;
+    }
+    else if(data < 0x80) {
+        rle_literal = data + 1;
+    }
+    else {
+        rle_repeat = data - 0x7e;
+    }
+}
+
+// Serial data RX interrupt
+#pragma vector=USCIAB0RX_VECTOR
+__interrupt void USCI0RX_ISR(void) {
+    stat_count[STAT_RX_BYTES]++;
+    // Input at the prompt restarts the idle timeouts
+    if(at_prompt)
+        idle_overflows = 0;
+    if(deep_idle) {
+        // The USCI restarted SMCLK for this byte; keep it
+        // running, back in wait_for_command()'s LPM0
+        deep_idle = false;
+        __bic_SR_register_on_exit(SCG1 + SCG0);
+    }
+    if(serial_mode == SERMODE_STREAM) {
+        if(stream_full[stream_fill] || write_buf_target_size == 0) {
+            // client exceeded its credit, or sent
+            // past the end: drop the byte
+            (void)UCA0RXBUF;
+            stream_overrun = true;
+            return;
+        }
+        rx_store(write_buf[stream_fill], UCA0RXBUF);
+        if(write_buf_idx >= write_buf_target_size) {
+            // page complete: hand it to cmd_write_stream()
+            // and start filling the other buffer
+            stream_len[stream_fill] = write_buf_idx;
+            stream_full[stream_fill] = true;
+            stream_rx_addr += write_buf_idx;
+            stream_rx_remaining -= write_buf_idx;
+            stream_fill = (stream_fill + 1) % WRITE_BUFS;
+            write_buf_idx = 0;
+            rle_literal = 0;
+            rle_repeat = 0;
+            write_buf_target_size = page_len(stream_rx_addr, stream_rx_remaining);
+            __bic_SR_register_on_exit(LPM0_bits);
+        }
+    }
+    else if(serial_mode == SERMODE_WRITE) {
+        // batch collects its list across all of write_buf
+        rx_store((char *)write_buf, UCA0RXBUF);
+        // once we have collected enough bytes, wake the CPU back up
+        if(write_buf_idx >= write_buf_target_size) {
+            __bic_SR_register_on_exit(LPM0_bits);
+        }
+    }
+    else if(serial_mode == SERMODE_ECHO) {
+        if(echo_mode) echo(UCA0RXBUF);
+        __bic_SR_register_on_exit(LPM0_bits);
+    }
+    else if(serial_mode == SERMODE_BINARY) {
+        cmd[bin_idx++] = UCA0RXBUF;
+        // opcode, length, payload and crc8; a bad length
+        // ends the frame when cmd is full
+        if(bin_idx == sizeof(cmd) || (bin_idx >= 3 && bin_idx == (uint8_t)cmd[1] + 3)) {
+            cmd_done = true;
+            __bic_SR_register_on_exit(LPM0_bits);
+        }
+    }
+    else if(serial_mode == SERMODE_CMD) {
+        if(cmd[0] == 0 && UCA0RXBUF == BIN_START) {
+            // a binary frame follows, see cmd_binary()
+            serial_mode = SERMODE_BINARY;
+            bin_idx = 0;
+        }
+        else if(UCA0RXBUF == 0x0d) {
+            if(echo_mode) send_str("\r\n");
+            // when command is complete, wake the CPU back up
+            cmd_done = true;
+            __bic_SR_register_on_exit(LPM0_bits);
+        }
+        else {
+            if(echo_mode) echo(UCA0RXBUF);
+            strncat(cmd, &UCA0RXBUF, 1);
+        }
+    }
+}
+
+// Timer_A overflow interrupt: extends TAR for timer_now()
+#pragma vector=TIMER0_A1_VECTOR
+__interrupt void TIMER0_A1_ISR(void) {
+    // Reading TAIV clears TAIFG, the only source enabled
+    if(TAIV == TA0IV_TAIFG) {
+        timer_overflows++;
+        // unlock's idle timeout, see wait_for_command()
+        if(sdp_unlocked && at_prompt && ++idle_overflows >= relock_overflows) {
+            relock_due = true;
+            __bic_SR_register_on_exit(LPM0_bits);
+        }
+        // Drop to LPM3 once the prompt has been idle for
+        // idle_limit, and only if wait_for_command() is
+        // asleep and has nothing to relock.  SMCLK stops, so
+        // this is the last overflow until the RX ISR wakes.
+        else if(!sdp_unlocked && at_prompt && idle_limit && (__get_SR_register_on_exit() & CPUOFF)
+                && baud_table[baud_idx].rate <= DEEP_IDLE_MAX_RATE && ++idle_overflows >= idle_limit) {
+            deep_idle = true;
+            __bis_SR_register_on_exit(LPM3_bits);
+        }
+    }
+}
+
+// Echos a char back to the client
+void echo(char chr) {
+    char to_send[2];
+    to_send[0] = chr;
+    to_send[1] = 0x00;
+    send_str(to_send);
+}
+
+// Queues a single raw byte for the client.  Unlike
+// send_str(), this can send 0x00.  Returns as soon as
+// the byte is in tx_buf; USCI0TX_ISR sends it.
+void send_byte(uint8_t chr) {
+    uint16_t gie = __get_SR_register() & GIE;
+
+    // The main loop and the RX ISR (echo) both queue
+    // bytes, so keep the ISR out while we update tx_head
+    __disable_interrupt();
+
+    // If the buffer is full, feed the USCI by hand
+    // until there is room
+    if(((tx_head + 1) & TX_BUF_MASK) == tx_tail) {
+        STAT_BEGIN();
+        while(((tx_head + 1) & TX_BUF_MASK) == tx_tail) {
+            if(IFG2 & UCA0TXIFG) { // USCI_A0 TX buffer ready?
+                UCA0TXBUF = tx_buf[tx_tail];
+                tx_tail = (tx_tail + 1) & TX_BUF_MASK;
+            }
+        }
+        // Echo from the RX ISR waits here too; leave that to
+        // the wait it interrupted
+        if(gie)
+            STAT_END(STAT_TX);
+    }
+    stat_count[STAT_TX_BYTES]++;
+
+    tx_buf[tx_head] = chr;
+    tx_head = (tx_head + 1) & TX_BUF_MASK;
+    IE2 |= UCA0TXIE;
+
+    if(gie)
+        __enable_interrupt();
+}
+
+// Sends a string to the client
+void send_str(char *str) {
+    char *ptr = str;
+    while(*ptr) {
+        send_byte(*ptr);
+        ptr++;
+    }
+}
+
+// Waits until everything in tx_buf has been sent.
+// Interrupts must be enabled.
+void tx_flush() {
+    uint32_t start = timer_now();
+
+    while(tx_head != tx_tail);
+    while(UCA0STAT & UCBUSY);
+    stat_ticks[STAT_TX] += timer_now() - start;
+}
+
+// Serial data TX interrupt: send the next byte
+// from tx_buf, and stop when it is empty
+#pragma vector=USCIAB0TX_VECTOR
+__interrupt void USCI0TX_ISR(void) {
+    if(tx_tail != tx_head) {
+        UCA0TXBUF = tx_buf[tx_tail];
+        tx_tail = (tx_tail + 1) & TX_BUF_MASK;
+    }
+    if(tx_tail == tx_head)
+        IE2 &= ~UCA0TXIE;
+}
+
+// Returns the ~CE flag bits that select the sockets
+// in mask: low for those sockets, high for the rest
+uint8_t ce_flags(uint8_t mask) {
+    uint8_t flags = CE_ALL;
+    for(uint8_t s=0; s<SOCKETS; s++) {
+        if(mask & (1 << s))
+            flags &= ~socket_ce[s];
+    }
+    return flags;
+}
+
+// Enables the sockets in mask and disables the rest,
+// leaving the other flags as they are
+void select_sockets(uint8_t mask) {
+    eeprom_flags = (eeprom_flags & ~CE_ALL) | ce_flags(mask);
+    send_flags(eeprom_flags);
+}
+
+#if defined(BOARD_SPI) || defined(SHIFTREG_GENERIC)
 // Send a one-byte set of flags to the flags shift register
 void send_flags(uint8_t flags) {
+#ifdef BOARD_DIRECT_OE
+    // ~OE is wired to OE_DIRECT rather than Qb
+    if(flags & _OE)
+        P1OUT |= OE_DIRECT;
+    else
+        P1OUT &= ~OE_DIRECT;
+#endif
+    STAT_BEGIN();
     shiftreg_send(&flags, SENDMODE_FLAG);
+    STAT_END(STAT_SHIFT);
     return;
 }
 
@@ -635,16 +2886,161 @@ void send_addr(uint16_t addr) {
     uint8_t to_send[2];
     to_send[0] = (addr & 0x00ff);
     to_send[1] = ((addr & 0xff00) >> 8);
+    STAT_BEGIN();
     shiftreg_send(to_send, SENDMODE_ADDR);
+    STAT_END(STAT_SHIFT);
     return;
 }
 
 // Send one byte to the data-out shift register
 void send_data(uint8_t data) {
+    STAT_BEGIN();
     shiftreg_send(&data, SENDMODE_DATA);
+    STAT_END(STAT_SHIFT);
     return;
 }
+#else
+/*
+   Unrolled shift-out for each chain.  The port and pins
+   are constants, so each bit is a test and a few
+   bis.b/bic.b on PxOUT, with no loop or port switch.
+   Build with -DSHIFTREG_GENERIC to use shiftreg_send()
+   instead.
+*/
+// Put bit b of val on SER and strobe SRCLK
+#define SHIFT_BIT(port, ser, srclk, val, b) do { \
+        if((val) & (1 << (b))) port |= (ser);   \
+        else port &= ~(ser);                     \
+        port |= (srclk);                         \
+        port &= ~(srclk);                        \
+    } while(0)
+// Shift a byte out LSB first
+#define SHIFT_BYTE(port, ser, srclk, val) do { \
+        SHIFT_BIT(port, ser, srclk, val, 0);   \
+        SHIFT_BIT(port, ser, srclk, val, 1);   \
+        SHIFT_BIT(port, ser, srclk, val, 2);   \
+        SHIFT_BIT(port, ser, srclk, val, 3);   \
+        SHIFT_BIT(port, ser, srclk, val, 4);   \
+        SHIFT_BIT(port, ser, srclk, val, 5);   \
+        SHIFT_BIT(port, ser, srclk, val, 6);   \
+        SHIFT_BIT(port, ser, srclk, val, 7);   \
+    } while(0)
+// Reset SER and strobe RCLK to latch the outputs
+#define SHIFT_LATCH(port, ser, rclk) do { \
+        port &= ~(ser);                   \
+        port |= (rclk);                   \
+        port &= ~(rclk);                  \
+    } while(0)
+
+// Send a one-byte set of flags to the flags shift register
+void send_flags(uint8_t flags) {
+    STAT_BEGIN();
+#ifdef BOARD_GANG
+    // Socket ~CEs first, so they end up on Qh-Qd
+    SHIFT_BIT(P1OUT, SER_F, SRCLK_F, flags, 3);
+    SHIFT_BIT(P1OUT, SER_F, SRCLK_F, flags, 4);
+    SHIFT_BIT(P1OUT, SER_F, SRCLK_F, flags, 5);
+    SHIFT_BIT(P1OUT, SER_F, SRCLK_F, flags, 6);
+    SHIFT_BIT(P1OUT, SER_F, SRCLK_F, flags, 7);
+#endif
+    // Only Qa-Qc are wired
+    SHIFT_BIT(P1OUT, SER_F, SRCLK_F, flags, 0);
+    SHIFT_BIT(P1OUT, SER_F, SRCLK_F, flags, 1);
+    SHIFT_BIT(P1OUT, SER_F, SRCLK_F, flags, 2);
+    SHIFT_LATCH(P1OUT, SER_F, RCLK_F);
+    STAT_END(STAT_SHIFT);
+}
+
+#ifdef BOARD_SPLIT_ADDR
+// High byte currently latched on the address bus;
+// 0x100 forces the first send_addr() to send both
+uint16_t addr_hi_latched = 0x100;
+
+// Send the address, skipping the high byte when it
+// hasn't changed
+void send_addr(uint16_t addr) {
+    uint8_t lo = addr & 0x00ff;
+    uint8_t hi = (addr & 0xff00) >> 8;
+    STAT_BEGIN();
+    if(hi != addr_hi_latched) {
+        SHIFT_BYTE(P1OUT, SER_A, SRCLK_A, hi);
+        SHIFT_BYTE(P1OUT, SER_A, SRCLK_A, lo);
+        // Latch the high byte; RCLK_A below latches the low
+        P2OUT |= RCLK_AH;
+        P2OUT &= ~RCLK_AH;
+        addr_hi_latched = hi;
+    }
+    else {
+        SHIFT_BYTE(P1OUT, SER_A, SRCLK_A, lo);
+    }
+    SHIFT_LATCH(P1OUT, SER_A, RCLK_A);
+    STAT_END(STAT_SHIFT);
+}
+#else
+// Send two bytes to the address shift register
+void send_addr(uint16_t addr) {
+    uint8_t lo = addr & 0x00ff;
+    uint8_t hi = (addr & 0xff00) >> 8;
+    STAT_BEGIN();
+    SHIFT_BYTE(P1OUT, SER_A, SRCLK_A, lo);
+    SHIFT_BYTE(P1OUT, SER_A, SRCLK_A, hi);
+    SHIFT_LATCH(P1OUT, SER_A, RCLK_A);
+    STAT_END(STAT_SHIFT);
+}
+#endif
+
+// Send one byte to the data-out shift register
+void send_data(uint8_t data) {
+    STAT_BEGIN();
+    SHIFT_BYTE(P2OUT, SER_DOUT, SRCLK_DOUT, data);
+    SHIFT_LATCH(P2OUT, SER_DOUT, RCLK_DOUT);
+    STAT_END(STAT_SHIFT);
+}
+#endif
+
+#ifdef BOARD_SPI
+// Sends one byte out USCI_B0.  Every chain shifts it in.
+void spi_send(uint8_t data) {
+    while (!(IFG2 & UCB0TXIFG)); // USCI_B0 TX buffer ready?
+    UCB0TXBUF = data;
+}
 
+// Shift register interface, hardware SPI version.
+// Waits for the last bit to leave USCI_B0, then
+// strobes the RCLK of the chain the bytes were for.
+void shiftreg_send(uint8_t *data_arr, uint8_t sendmode) {
+    switch(sendmode) {
+        case SENDMODE_FLAG:
+            // Only Qa-Qc are wired, and the first bit out
+            // ends up on Qh, so push the 3 flag bits up.
+            // With BOARD_GANG, bits 3-7 wrap around to
+            // Qh-Qd.
+#ifdef BOARD_GANG
+            spi_send((data_arr[0] << 5) | (data_arr[0] >> 3));
+#else
+            spi_send(data_arr[0] << 5);
+#endif
+            while(UCB0STAT & UCBUSY);
+            P1OUT |= RCLK_F;
+            P1OUT &= ~RCLK_F;
+            break;
+        case SENDMODE_DATA:
+            spi_send(data_arr[0]);
+            while(UCB0STAT & UCBUSY);
+            P2OUT |= RCLK_DOUT;
+            P2OUT &= ~RCLK_DOUT;
+            break;
+        case SENDMODE_ADDR:
+            spi_send(data_arr[0]);
+            spi_send(data_arr[1]);
+            while(UCB0STAT & UCBUSY);
+            P1OUT |= RCLK_A;
+            P1OUT &= ~RCLK_A;
+            break;
+    }
+    return;
+}
+#else
 // Generic shift register interface
 void shiftreg_send(uint8_t *data_arr, uint8_t sendmode) {
     uint8_t SER = 0;
@@ -653,12 +3049,21 @@ void shiftreg_send(uint8_t *data_arr, uint8_t sendmode) {
     uint8_t count = 1;
     uint8_t max_bit = 7;
     uint8_t port = 1;
+#ifdef BOARD_GANG
+    uint8_t gang_flags;
+#endif
     switch(sendmode) {
         case SENDMODE_FLAG:
             SER = SER_F;
             SRCLK = SRCLK_F;
             RCLK = RCLK_F;
+#ifdef BOARD_GANG
+            // Socket ~CEs first, so they end up on Qh-Qd
+            gang_flags = (data_arr[0] >> 3) | (data_arr[0] << 5);
+            data_arr = &gang_flags;
+#else
             max_bit = 2;
+#endif
             break;
         case SENDMODE_DATA:
             SER = SER_DOUT;
@@ -731,5 +3136,4 @@ void shiftreg_send(uint8_t *data_arr, uint8_t sendmode) {
 
     return;
 }
-
-
+#endif